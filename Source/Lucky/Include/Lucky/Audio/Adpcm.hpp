@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace Lucky
+{
+    // IMA-ADPCM in blocks that can be decoded on their own. Each block holds AdpcmBlockFrames
+    // frames: per channel a 4 byte header with the first sample and the step index, then per
+    // channel the remaining frames as 4 bit codes, low nibble first. About a quarter of the
+    // size of 16 bit PCM.
+    constexpr uint32_t AdpcmBlockFrames = 257;
+
+    constexpr uint32_t GetAdpcmBlockSize(uint16_t channels)
+    {
+        return channels * (4 + (AdpcmBlockFrames - 1) / 2);
+    }
+
+    // Appends the encoding of frameCount interleaved frames to output, the last block is padded
+    void EncodeAdpcm(const int16_t *samples, uint32_t frameCount, uint16_t channels, std::vector<uint8_t> &output);
+
+    // Decodes frameCount interleaved frames starting at firstFrame, only the blocks they fall in
+    // are touched so sounds can be read from anywhere
+    void DecodeAdpcm(
+        const uint8_t *blocks, uint16_t channels, uint32_t firstFrame, uint32_t frameCount, int16_t *output);
+} // namespace Lucky
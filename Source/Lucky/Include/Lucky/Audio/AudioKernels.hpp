@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace Lucky
+{
+    // Sample kernels for mixing. Float samples are in [-1, 1], frames are interleaved stereo
+    // where a kernel says so. Each has a plain C++ version kept as a reference and for comparing
+    // performance. The SSE2, AVX2 and NEON paths are written to match it bit for bit, which relies
+    // on the compiler not fusing multiplies and adds, so AudioKernels.cpp turns FP contraction off.
+
+    // output = input / 32768
+    void ConvertToFloat(const int16_t *input, float *output, uint32_t sampleCount);
+    void ConvertToFloatScalar(const int16_t *input, float *output, uint32_t sampleCount);
+
+    // output = input * 32768 rounded to nearest even and saturated to the int16_t range
+    void ConvertToSamples(const float *input, int16_t *output, uint32_t sampleCount);
+    void ConvertToSamplesScalar(const float *input, int16_t *output, uint32_t sampleCount);
+
+    void ApplyGain(float *samples, uint32_t sampleCount, float gain);
+    void ApplyGainScalar(float *samples, uint32_t sampleCount, float gain);
+
+    // Stereo frames, the gain moves linearly from startGain on the first frame towards endGain,
+    // reaching it on the frame after the last so consecutive ramps join up without a step
+    void ApplyGainRamp(float *frames, uint32_t frameCount, float startGain, float endGain);
+    void ApplyGainRampScalar(float *frames, uint32_t frameCount, float startGain, float endGain);
+
+    // Stereo frames, pan runs from -1 (left only) to 1 (right only). The centre leaves both
+    // sides unchanged and the side being turned down falls off with constant power.
+    void PanStereo(float *frames, uint32_t frameCount, float pan);
+    void PanStereoScalar(float *frames, uint32_t frameCount, float pan);
+
+    // bus += input * gain / 32768, converts and sums a voice in one pass
+    void MixSamples(const int16_t *input, float *bus, uint32_t sampleCount, float gain);
+    void MixSamplesScalar(const int16_t *input, float *bus, uint32_t sampleCount, float gain);
+
+    // bus += input
+    void AccumulateSamples(const float *input, float *bus, uint32_t sampleCount);
+    void AccumulateSamplesScalar(const float *input, float *bus, uint32_t sampleCount);
+
+    // Clips samples to [-1, 1], NaN becomes -1
+    void ClampSamples(float *samples, uint32_t sampleCount);
+    void ClampSamplesScalar(float *samples, uint32_t sampleCount);
+} // namespace Lucky
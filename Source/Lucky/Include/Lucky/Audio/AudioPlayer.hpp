@@ -14,8 +14,18 @@
 
 namespace Lucky
 {
+    // Handle to a playing instance, its slot and the slot's generation packed together. Once the
+    // instance finishes the handle reads as Stopped and is ignored, even after the slot is reused
+    // by another play. 0 is never a valid handle.
     typedef uint32_t AudioRef;
 
+    // Index of a sound group, resolve a name once with GetSoundGroupId and keep the id. A destroyed
+    // group's id is given to the next group created.
+    typedef uint32_t SoundGroupId;
+
+    // The "default" group is created first and always has id 0
+    constexpr SoundGroupId DefaultSoundGroupId = 0;
+
     enum class AudioState
     {
         Playing,
@@ -27,6 +37,44 @@ namespace Lucky
     {
         SDL_AudioDeviceID deviceId = SDL_AUDIO_DEVICE_DEFAULT_OUTPUT;
         float volume = 1.0f;
+
+        // Most instances in the group mixed at once, 0 for no limit beyond AudioMixSettings
+        uint32_t maxVoices = 0;
+    };
+
+    enum class AudioMixMode
+    {
+        // Update mixes on the game thread and keeps queueTime of audio queued ahead
+        Polled,
+
+        // Each group mixes on its device's audio thread as the device asks for more, Update only
+        // cleans up instances that finished
+        Callback,
+    };
+
+    struct AudioMixSettings
+    {
+        AudioMixMode mode = AudioMixMode::Polled;
+
+        // Seconds of audio Polled mode keeps queued, it has to cover the longest frame
+        float queueTime = 1 / 30.0f;
+
+        // Device buffer size asked for in Callback mode, it bounds how long a Play takes to be
+        // heard. 256 frames is about 5 ms at 48 kHz, 0 leaves it to SDL. Devices may not honor it.
+        uint32_t bufferFrames = 256;
+
+        // Play, Pause, Resume, Stop and volume changes each group can have waiting for the mixer
+        uint32_t commandCapacity = 1024;
+
+        // Seconds of audio a background thread keeps decoded ahead of each playing stream. The
+        // mixer plays silence when a stream runs dry, counted by GetUnderrunCount.
+        float streamLookahead = 0.5f;
+
+        // Most instances mixed at once across every group, 0 for no limit. Playing instances past
+        // a limit, or in a group with no volume, go virtual: they keep their place without being
+        // decoded or mixed and come back once they win a voice again. Higher priority wins, then
+        // the more recently played.
+        uint32_t maxVoices = 64;
     };
 
     struct AudioDevice
@@ -41,29 +89,55 @@ namespace Lucky
 
         static std::vector<AudioDevice> GetAudioOutputDevices();
 
-        AudioPlayer(SoundGroupSettings defaultSoundGroupSettings = SoundGroupSettings());
+        AudioPlayer(SoundGroupSettings defaultSoundGroupSettings = SoundGroupSettings(),
+            AudioMixSettings mixSettings = AudioMixSettings());
         ~AudioPlayer();
 
-        void CreateSoundGroup(const std::string &soundGroupName, SoundGroupSettings settings = SoundGroupSettings());
+        // Creates the group or updates the settings of the one with that name
+        SoundGroupId CreateSoundGroup(
+            const std::string &soundGroupName, SoundGroupSettings settings = SoundGroupSettings());
         void DestroySoundGroup(const std::string &soundGroupName);
+        void DestroySoundGroup(SoundGroupId soundGroupId);
+
+        SoundGroupId GetSoundGroupId(const std::string &soundGroupName);
 
         void StopGroup(const std::string &soundGroupName);
+        void StopGroup(SoundGroupId soundGroupId);
         void PauseGroup(const std::string &soundGroupName);
+        void PauseGroup(SoundGroupId soundGroupId);
         void ResumeGroup(const std::string &soundGroupName);
+        void ResumeGroup(SoundGroupId soundGroupId);
 
         SDL_AudioDeviceID GetGroupDeviceId(const std::string &soundGroupName);
+        SDL_AudioDeviceID GetGroupDeviceId(SoundGroupId soundGroupId);
         float GetGroupVolume(const std::string &soundGroupName);
-
-        AudioRef Play(
-            std::shared_ptr<Sound> sound, const std::string &soundGroupName = "default", const bool loop = false);
-        AudioRef Play(
-            std::shared_ptr<Stream> stream, const std::string &soundGroupName = "default", const bool loop = false);
+        float GetGroupVolume(SoundGroupId soundGroupId);
+
+        // Playing into a group by name creates it with the default settings if it doesn't exist
+        AudioRef Play(std::shared_ptr<Sound> sound, const std::string &soundGroupName = "default",
+            const bool loop = false, const int priority = 0);
+        AudioRef Play(std::shared_ptr<Sound> sound, SoundGroupId soundGroupId, const bool loop = false,
+            const int priority = 0);
+        AudioRef Play(std::shared_ptr<Stream> stream, const std::string &soundGroupName = "default",
+            const bool loop = false, const int priority = 0);
+        AudioRef Play(std::shared_ptr<Stream> stream, SoundGroupId soundGroupId, const bool loop = false,
+            const int priority = 0);
         void Pause(const AudioRef &audioRef);
         void Resume(const AudioRef &audioRef);
         void Stop(const AudioRef &audioRef);
 
         AudioState GetState(const AudioRef &audioRef);
 
+        // Whether a playing instance lost its voice to the limits, as of the last Update
+        bool IsVirtual(const AudioRef &audioRef);
+        uint32_t GetVirtualVoiceCount();
+
+        // Times a playing stream ran out of decoded audio, 0 for sounds and finished streams
+        uint32_t GetUnderrunCount(const AudioRef &audioRef);
+
+        // Underruns of every stream played so far
+        uint64_t GetStreamUnderrunCount();
+
         void Update();
 
       private:
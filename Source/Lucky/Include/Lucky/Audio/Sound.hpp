@@ -6,17 +6,37 @@
 
 namespace Lucky
 {
+    // How a sound keeps its samples in memory
+    enum class SoundEncoding
+    {
+        Pcm,
+
+        // IMA-ADPCM, about a quarter the size of Pcm for a little decode work on every read and
+        // some loss of quality. Suits large effect libraries better than quiet, clean music.
+        Adpcm,
+    };
+
     struct Sound
     {
         uint32_t totalFrames;
         uint32_t sampleRate;
         uint16_t channels;
+        SoundEncoding encoding;
+
+        // interleaved samples when encoding is Pcm, ADPCM blocks when it's Adpcm
         std::vector<int16_t> frames;
+        std::vector<uint8_t> blocks;
 
-        Sound(const std::string &filename);
-        Sound(void *buffer, uint32_t bufferByteSize);
+        Sound(const std::string &filename, SoundEncoding encoding = SoundEncoding::Pcm);
+        Sound(void *buffer, uint32_t bufferByteSize, SoundEncoding encoding = SoundEncoding::Pcm);
         ~Sound() = default;
 
         uint32_t GetFrames(uint32_t &position, int16_t *buffer, uint32_t frames, bool *loop);
+
+        // Bytes the samples take up in memory
+        size_t GetMemorySize() const;
+
+      private:
+        void SetSamples(const int16_t *samples);
     };
 } // namespace Lucky
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <dr_mp3.h>
 #include <stb_vorbis.h>
@@ -10,28 +12,55 @@ namespace Lucky
     class Stream
     {
       public:
+        // Reads the whole compressed file into memory, copies decode from those bytes and never
+        // go back to the disk
         Stream(const std::string &fileName);
+
+        // The buffer isn't copied, it has to outlive the stream and every copy of it
         Stream(void *buffer, uint32_t bufferByteSize);
+
+        // Shares the compressed bytes and only opens a new decoder on them
         Stream(const Stream &stream);
         ~Stream();
 
         uint32_t GetFrames(int16_t *buffer, uint32_t frames, bool *loop);
 
+        // Moves frames ahead without decoding them, wrapping to the start when loop is set, and
+        // returns how many frames it moved, fewer only once a stream that doesn't loop ends. The
+        // decoder only seeks on the next GetFrames, so skipping again and again stays cheap.
+        uint32_t SkipFrames(uint32_t frames, bool loop);
+
+        // Size of the compressed data the stream decodes from
+        uint32_t GetByteSize() const
+        {
+            return bufferByteSize;
+        }
+
         uint32_t sampleRate;
         uint16_t channels;
 
       private:
-        enum class StreamSource
-        {
-            File,
-            Memory,
-        };
+        // Opens a decoder on buffer, trying Vorbis first unless it's known to be an MP3
+        bool Open(bool isMp3);
+
+        // Length in frames, counted the first time it's asked for
+        uint64_t GetFrameCount();
 
-        StreamSource streamSource;
         std::string fileName;
-        void *buffer;
+
+        // null when the bytes belong to the caller
+        std::shared_ptr<const std::vector<uint8_t>> fileData;
+        const void *buffer;
         uint32_t bufferByteSize;
+
         stb_vorbis *vorbis;
         drmp3 *mp3;
+
+        // frame GetFrames reads next, SkipFrames moves it and leaves the decoder to seek there
+        uint64_t position;
+        bool seekPending;
+
+        // UINT64_MAX until GetFrameCount counts it
+        uint64_t frameCount;
     };
 } // namespace Lucky
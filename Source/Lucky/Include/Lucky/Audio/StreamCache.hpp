@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+#include <Lucky/Audio/Stream.hpp>
+
+namespace Lucky
+{
+    // Loads streams by path and keeps them, and their compressed bytes, in memory. Playing the
+    // stream it returns copies it from those bytes, so firing the same music or voice line again
+    // never reads the file a second time.
+    struct StreamCache
+    {
+      public:
+        StreamCache() = default;
+        StreamCache(const StreamCache &) = delete;
+
+        StreamCache &operator=(const StreamCache &) = delete;
+
+        std::shared_ptr<Stream> Get(const std::string &fileName);
+
+        bool Contains(const std::string &fileName) const;
+
+        // Instances already playing keep the bytes until they finish
+        void Remove(const std::string &fileName);
+        void Clear();
+
+        uint64_t GetResidentBytes() const
+        {
+            return residentBytes;
+        }
+
+      private:
+        std::unordered_map<std::string, std::shared_ptr<Stream>> entries;
+        uint64_t residentBytes = 0;
+    };
+} // namespace Lucky
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include <Lucky/Audio/Stream.hpp>
+#include <Lucky/Utility/SpscQueue.hpp>
+
+namespace Lucky
+{
+    // One playing stream's decoded frames. The decoder thread keeps them topped up and the mixer
+    // takes them, so decoding never happens on the thread that mixes.
+    struct DecodedStream
+    {
+      public:
+        DecodedStream(std::unique_ptr<Stream> stream, bool shouldLoop, uint32_t lookaheadFrames);
+
+        DecodedStream(const DecodedStream &) = delete;
+        DecodedStream &operator=(const DecodedStream &) = delete;
+
+        // Mixer side. Copies frameCount frames to buffer and returns how many there were, fewer
+        // only once a stream that doesn't loop has ended. When the decoder has fallen behind the
+        // missing frames are silence and count as an underrun.
+        uint32_t GetFrames(int16_t *buffer, uint32_t frameCount);
+
+        // Mixer side. Drops frameCount frames as GetFrames would have returned them, a stream
+        // that can't be heard doesn't count an underrun. Frames not decoded yet are owed, and the
+        // decoder moves the stream past them before decoding any more.
+        uint32_t SkipFrames(uint32_t frameCount);
+
+        // A paused stream isn't decoded, the decoder only keeps it caught up with the frames
+        // skipped so it carries on from the right place. For streams that have lost their voice,
+        // once unpaused they play silence in time until the decoder has refilled them.
+        void SetPaused(bool isPaused);
+
+        // Decoder side. Decodes until the lookahead is full or the stream ends.
+        void Decode(std::vector<int16_t> &scratch);
+
+        // Stops the decoder topping this stream up, its owner is going away
+        void Cancel();
+        bool IsCancelled() const;
+
+        uint32_t GetUnderrunCount() const;
+
+        const uint16_t channels;
+
+      private:
+        std::unique_ptr<Stream> stream;
+        const bool shouldLoop;
+
+        SpscQueue<int16_t> samples;
+
+        // set by the decoder once it has pushed the stream's last frame, or its first
+        std::atomic<bool> ended{false};
+        std::atomic<bool> started{false};
+
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> paused{false};
+        std::atomic<uint32_t> owedFrames{0};
+
+        // set when unpaused until the mixer gets frames again, running dry until then isn't an underrun
+        std::atomic<bool> resuming{false};
+        std::atomic<uint32_t> underrunCount{0};
+    };
+
+    // Owns the thread that decodes every playing stream ahead of the mixer
+    class StreamDecoder
+    {
+      public:
+        // lookahead is the seconds of audio kept decoded ahead of each stream
+        StreamDecoder(float lookahead);
+        ~StreamDecoder();
+
+        // Hands a stream to the decoder thread, which starts filling it straight away
+        std::shared_ptr<DecodedStream> Add(std::unique_ptr<Stream> stream, bool shouldLoop);
+
+        // Starts the next pass now rather than when it's due, for a stream that needs filling
+        void Wake();
+
+        // Underruns of every stream added so far
+        uint64_t GetUnderrunCount();
+
+      private:
+        StreamDecoder(const StreamDecoder &) = delete;
+        StreamDecoder &operator=(const StreamDecoder &) = delete;
+
+        void Run();
+
+        const float lookahead;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+        bool woken = false;
+
+        // cancelled streams are dropped on the decoder's next pass and their underruns kept here
+        std::vector<std::shared_ptr<DecodedStream>> streams;
+        uint64_t droppedUnderrunCount = 0;
+
+        std::thread thread;
+    };
+} // namespace Lucky
@@ -59,27 +59,52 @@ namespace Lucky
             return batchStarted;
         }
 
+        // Most textures a single batch can sample from
+        static constexpr uint32_t MaximumTextures = 4;
+
         void Begin(BlendMode blendMode, std::shared_ptr<Texture> texture,
             std::shared_ptr<ShaderProgram> shaderProgram = nullptr, const glm::mat4 &transformMatrix = glm::mat4(1.0f));
+
+        // Binds up to MaximumTextures textures at once, so quads from different pages of an
+        // atlas can go into the same draw call. Quads pick a texture with their textureIndex.
+        // A custom shader program reads the index from the textureindex attribute and samples
+        // TextureSampler, TextureSampler1, TextureSampler2 or TextureSampler3.
+        void Begin(BlendMode blendMode, const std::vector<std::shared_ptr<Texture>> &textures,
+            std::shared_ptr<ShaderProgram> shaderProgram = nullptr, const glm::mat4 &transformMatrix = glm::mat4(1.0f));
         void End();
 
-        void BatchQuadUV(
-            const glm::vec2 &uv0, const glm::vec2 &uv1, const glm::vec2 &xy0, const glm::vec2 &xy1, const Color &color);
+        void BatchQuadUV(const glm::vec2 &uv0, const glm::vec2 &uv1, const glm::vec2 &xy0, const glm::vec2 &xy1,
+            const Color &color, uint32_t textureIndex = 0);
 
         void BatchQuad(Rectangle *sourceRectangle, const glm::vec2 &position, const float rotation,
-            const glm::vec2 &scale, const glm::vec2 &origin, const UVMode uvMode, const Color &color);
+            const glm::vec2 &scale, const glm::vec2 &origin, const UVMode uvMode, const Color &color,
+            uint32_t textureIndex = 0);
 
         void BatchTriangles(Vertex *triangleVertices, const int triangleCount);
 
-      private:
+        // Copies whole triangles moved by offset with their colors multiplied by color, for
+        // replaying vertices that were built once like a TextLayout's
+        void BatchVertices(const Vertex *triangleVertices, uint32_t vertexCount, const glm::vec2 &offset,
+            const Color &color);
+
+        // Draws everything batched so far and keeps the batch open
         void Flush();
 
+      private:
+        // see Texture::HoldForBatch, glyph caches keep the glyphs of held textures' quads
+        void HoldTextures();
+        void ReleaseTextures();
+
         std::shared_ptr<GraphicsDevice> graphicsDevice;
-        std::shared_ptr<Texture> texture;
+        std::shared_ptr<Texture> textures[MaximumTextures];
+        uint32_t textureCount;
         std::shared_ptr<ShaderProgram> currentShaderProgram;
         std::unique_ptr<VertexShader> defaultVertexShader;
         std::unique_ptr<FragmentShader> defaultFragmentShader;
         std::shared_ptr<ShaderProgram> defaultShaderProgram;
+        std::unique_ptr<VertexShader> multiTextureVertexShader;
+        std::unique_ptr<FragmentShader> multiTextureFragmentShader;
+        std::shared_ptr<ShaderProgram> multiTextureShaderProgram;
         std::unique_ptr<VertexBuffer> vertexBuffer;
         glm::mat4 transformMatrix;
         BlendMode blendMode;
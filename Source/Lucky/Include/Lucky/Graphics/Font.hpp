@@ -2,7 +2,9 @@
 
 #include <map>
 #include <memory>
+#include <stdint.h>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -11,10 +13,27 @@
 
 #include <Lucky/Graphics/BatchRenderer.hpp>
 #include <Lucky/Graphics/Color.hpp>
+#include <Lucky/Graphics/GlyphCache.hpp>
+#include <Lucky/Graphics/TextLayout.hpp>
+#include <Lucky/Graphics/TextParagraph.hpp>
 #include <Lucky/Graphics/Texture.hpp>
 
 namespace Lucky
 {
+    class Font;
+
+    // One entry for Font::CreateSharedFontEntries, codePoints has to stay valid until it returns
+    struct FontEntryRequest
+    {
+        Font *font = nullptr;
+        std::string entryName;
+        float fontSize = 0.0f;
+        int *codePoints = nullptr;
+        int pointCount = 0;
+        uint32_t oversampling = 1;
+        bool kerningEnabled = true;
+    };
+
     class Font
     {
       public:
@@ -22,15 +41,64 @@ namespace Lucky
         Font(void *memory);
         ~Font();
 
-        // todo: future optimization - allow packing multiple sizes into one texture
         // todo: do we need to specify a maximum texture size?
         std::shared_ptr<Texture> CreateFontEntry(
             const std::string &entryName, const float fontSize, int *codePoints, int pointCount, uint32_t oversampling = 1, bool kerningEnabled = true);
+
+        // Packs the glyphs of every request into one texture, whatever their size or font, so text
+        // using any of the entries can be drawn in the same batch. Each entry is added to its
+        // request's font and the shared texture is returned.
+        static std::shared_ptr<Texture> CreateSharedFontEntries(const std::vector<FontEntryRequest> &requests);
+
+        // Dynamic entries rasterize glyphs the first time they're drawn into pageCount textures
+        // of pageSize x pageSize, evicting glyphs that haven't been used recently when they fill
+        // up. Use these for large character sets. Entries with more than one page need all of
+        // their textures bound, see GetTextures and the multi-texture BatchRenderer::Begin.
+        std::shared_ptr<Texture> CreateDynamicFontEntry(const std::string &entryName, const float fontSize,
+            uint32_t pageSize = 1024, uint32_t pageCount = 1, bool kerningEnabled = true);
+
+        // Signed distance field entries store each glyph's distance to its outline in the alpha
+        // channel, with 0.5 on the edge and the field fading out over padding pixels at fontSize.
+        // They stay sharp when drawn at any size with SdfFontShader, so one entry can serve every
+        // size of a font.
+        std::shared_ptr<Texture> CreateSdfFontEntry(const std::string &entryName, const float fontSize,
+            int *codePoints, int pointCount, int padding = 8, bool kerningEnabled = true);
+
         std::shared_ptr<Texture> GetTexture(const std::string &entryName);
+        std::vector<std::shared_ptr<Texture>> GetTextures(const std::string &entryName);
 
+        // Text is UTF-8
         void DrawString(BatchRenderer &batchRenderer, const std::string &text, const std::string &entryName,
             const float x, const float y, Color color);
 
+        // Draws the entry scaled to fontSize, meant for distance field entries
+        void DrawString(BatchRenderer &batchRenderer, const std::string &text, const std::string &entryName,
+            const float x, const float y, Color color, const float fontSize);
+
+        // Bounds of the line DrawString would draw at 0, 0, from the pen's start to its end and from
+        // the font's ascent to its descent. A fontSize of 0 uses the entry's size.
+        TextBounds MeasureString(const std::string &text, const std::string &entryName, const float fontSize = 0.0f);
+
+        // Fills glyphs with where DrawString would put each glyph at x, y and returns the bounds
+        // like MeasureString. Code points the entry doesn't have are left out.
+        TextBounds LayoutString(const std::string &text, const std::string &entryName, const float x, const float y,
+            std::vector<GlyphPosition> &glyphs, const float fontSize = 0.0f);
+
+        // Shapes UTF-8 text into layout once, so static text can be drawn again without laying it
+        // out, see TextLayout and TextLayoutCache
+        void LayoutText(TextLayout &layout, const std::string &text, const std::string &entryName,
+            const TextLayoutOptions &options = TextLayoutOptions());
+
+        // Wraps the paragraph's lines again, only from the line before its first edit since the last
+        // call to the first line after its edits that starts where it used to. Changing the entry or
+        // options, or a dynamic entry evicting glyphs, lays out the whole paragraph.
+        void LayoutParagraph(TextParagraph &paragraph, const std::string &entryName,
+            const TextLayoutOptions &options = TextLayoutOptions());
+
+        // False when the entry was created again or a dynamic entry has evicted glyphs since the
+        // layout was made, or it's missing glyphs that didn't fit while a batch held the cache
+        bool IsLayoutCurrent(const TextLayout &layout, const std::string &entryName) const;
+
       private:
         void Initialize();
 
@@ -38,17 +106,91 @@ namespace Lucky
         bool shouldFreeMemory;
 
         stbtt_fontinfo fontInfo;
+        int ascent, descent, lineGap;
+
+        // bumped for every entry created so layouts of replaced entries can tell
+        uint32_t entryGeneration = 0;
+
+        // a glyph of either kind of entry, in pixels at the entry's size
+        struct GlyphQuad
+        {
+            float u0, v0, u1, v1;
+            float x0, y0, x1, y1;
+            float advance;
+
+            // what the entry's kerning is keyed by
+            uint32_t glyph;
+            uint32_t page;
+
+            // the glyph cache shelf holding a dynamic entry's glyph
+            uint32_t shelf;
+            bool visible;
+        };
 
         struct FontEntry
         {
+            // code points below this are looked up directly, covers ASCII and the Latin blocks
+            static constexpr int directGlyphCount = 0x250;
+            static constexpr uint32_t invalidGlyph = UINT32_MAX;
+
+            struct KerningPair
+            {
+                uint64_t glyphs;
+                int advance;
+            };
+
             float size;
             float scaleFactor;
             std::vector<stbtt_packedchar> packedData;
             std::vector<int> codePoints;
             std::shared_ptr<Lucky::Texture> texture;
-            std::map<std::pair<int, int>, int> kerning;
+            float inverseTextureWidth, inverseTextureHeight;
+            uint32_t generation;
+
+            // code point to index in packedData
+            std::vector<uint32_t> directGlyphs;
+            std::unordered_map<int, uint32_t> sparseGlyphs;
+
+            // open addressing table keyed by pairs of glyph indices, at most half full
+            std::vector<KerningPair> kerning;
+            uint32_t kerningCount = 0;
+
+            // only set for dynamic entries, their kerning is keyed by the font's glyph indices
+            std::shared_ptr<GlyphCache> glyphCache;
+            bool kerningEnabled = false;
+
+            bool distanceField = false;
+
+            void AddGlyph(int codePoint, uint32_t glyph);
+            uint32_t FindGlyph(int codePoint) const;
+
+            void AddKerning(uint32_t first, uint32_t second, int advance);
+            int GetKerning(uint32_t first, uint32_t second) const;
         };
 
+        void BuildKerning(FontEntry &entry);
+        bool FindGlyphQuad(FontEntry &entry, int codePoint, GlyphQuad &quad, BatchRenderer *batchRenderer = nullptr);
+        float GetKerningAdvance(FontEntry &entry, uint32_t first, uint32_t second);
+
+        // Finds the line starting at first, ending at a '\n', at the last space that keeps it
+        // within maximumWidth or mid word if one word is wider. Returns where the next line starts.
+        size_t WrapLine(FontEntry &entry, const int *codePoints, size_t count, size_t first, float maximumWidth,
+            float scale, size_t &last, float &width);
+        uint32_t GetBatchWaitCount(const FontEntry &entry) const;
+        uint64_t GetLayoutGeneration(const FontEntry &entry) const;
+        void DrawStringEntry(BatchRenderer &batchRenderer, FontEntry &entry, const std::string &text, float x,
+            float y, Color color, float scale);
+
+        // Calls visit(index, quad, x) for each code point the entry has a glyph for, with x the pen
+        // position after kerning, and returns the pen position after the last glyph. Quads going
+        // into batchRenderer may flush it to make room in a dynamic entry's glyph cache.
+        template <typename Visitor>
+        float WalkGlyphs(FontEntry &entry, const int *codePoints, size_t count, float x, float scale, Visitor visit,
+            BatchRenderer *batchRenderer = nullptr);
+
+        // decoded text for DrawString and friends, kept to avoid allocating every call
+        std::vector<int> codePointScratch;
+
         std::map<std::string, FontEntry> fontEntries;
     };
 } // namespace Lucky
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <stb_truetype.h>
+
+#include <Lucky/Graphics/Texture.hpp>
+
+namespace Lucky
+{
+    struct CachedGlyph
+    {
+        // texture coordinates on the glyph's page
+        float u0, v0, u1, v1;
+
+        // quad corners relative to the pen position on the baseline
+        float xoff, yoff, xoff2, yoff2;
+        float xadvance;
+
+        int fontGlyph;
+        uint32_t page;
+        uint32_t shelf;
+        bool empty;
+    };
+
+    // Rasterizes glyphs the first time they're used into a fixed set of atlas pages.
+    //
+    // Pages are split into shelves, horizontal strips for glyphs of a similar height
+    // that are filled left to right. When there's no room left the least recently
+    // used shelf is emptied and reused, which evicts all of its glyphs at once.
+    // Glyphs are rasterized into a CPU copy of the page and only their rectangle is
+    // queued for upload, so the upload happens with the next batch flush.
+    //
+    // Shelves used since the last call to BeginUse are never evicted, and neither are
+    // shelves touched for a batch until the BatchRenderer holding their page has drawn
+    // its quads, see Texture::HoldForBatch. If a single DrawString needs more glyphs than
+    // the pages can hold, the ones that don't fit are skipped.
+    struct GlyphCache
+    {
+      public:
+        GlyphCache(const stbtt_fontinfo &fontInfo, float fontSize, uint32_t pageSize, uint32_t pageCount);
+        GlyphCache(const GlyphCache &) = delete;
+        ~GlyphCache();
+
+        GlyphCache &operator=(const GlyphCache &) = delete;
+
+        // Marks the start of a run of lookups, shelves used after this are kept until the next call
+        void BeginUse()
+        {
+            useStamp++;
+        }
+
+        // Marks a glyph's shelf as used without looking it up, for quads built earlier. Touch it
+        // forBatch after its quad went into a BatchRenderer, so it's kept until the batch draws it.
+        void Touch(uint32_t shelf, bool forBatch);
+
+        // True when the last glyph couldn't be added only because shelves are held for a batch,
+        // flushing it makes room
+        bool IsWaitingForBatch() const
+        {
+            return waitingForBatch;
+        }
+
+        // Glyphs skipped so far because shelves were held for a batch, layouts made while this
+        // changes are missing glyphs that would fit after the batch is flushed
+        uint32_t GetBatchWaitCount() const
+        {
+            return batchWaitCount;
+        }
+
+        // Returns nullptr if the font doesn't have the glyph or it couldn't be fit into a page
+        const CachedGlyph *GetGlyph(int codePoint);
+
+        const std::vector<std::shared_ptr<Texture>> &GetTextures() const
+        {
+            return textures;
+        }
+
+        uint32_t GetGlyphCount() const
+        {
+            return (uint32_t)glyphs.size();
+        }
+
+        uint32_t GetEvictionCount() const
+        {
+            return evictionCount;
+        }
+
+      private:
+        struct Shelf
+        {
+            uint32_t page;
+            uint32_t y;
+            uint32_t height;
+            uint32_t x;
+            uint64_t lastUsed;
+
+            // the page texture's batch serial when the shelf was last touched for a batch
+            uint64_t batchSerial;
+            std::vector<int> codePoints;
+        };
+
+        struct Page
+        {
+            uint32_t nextShelfY;
+            std::vector<uint8_t> pixels;
+        };
+
+        void MarkUsed(Shelf &shelf, bool forBatch);
+        bool IsHeldForBatch(const Shelf &shelf) const;
+        const CachedGlyph *AddGlyph(int codePoint);
+        bool Allocate(uint32_t width, uint32_t height, uint32_t &shelfIndex, uint32_t &x, uint32_t &y);
+        void EvictShelf(Shelf &shelf);
+
+        const stbtt_fontinfo &fontInfo;
+        float scaleFactor;
+        uint32_t pageSize;
+
+        uint64_t useStamp = 1;
+        bool waitingForBatch = false;
+        uint32_t batchWaitCount = 0;
+        uint32_t evictionCount = 0;
+
+        std::vector<Page> pages;
+        std::vector<Shelf> shelves;
+        std::vector<std::shared_ptr<Texture>> textures;
+        std::unordered_map<int, CachedGlyph> glyphs;
+
+        // scratch buffer for the 8 bit coverage stbtt renders
+        std::vector<uint8_t> coverage;
+    };
+} // namespace Lucky
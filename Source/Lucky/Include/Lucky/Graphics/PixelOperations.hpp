@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace Lucky
+{
+    // Converts tightly packed RGBA8 pixels from straight to premultiplied alpha in place.
+    // Each color channel becomes round(c * a / 255), alpha is unchanged.
+    void PremultiplyAlpha(uint8_t *pixels, uint32_t pixelCount);
+
+    // Plain C++ version of PremultiplyAlpha. The vectorized paths produce identical
+    // results, this is kept around as a reference and for comparing performance.
+    void PremultiplyAlphaScalar(uint8_t *pixels, uint32_t pixelCount);
+} // namespace Lucky
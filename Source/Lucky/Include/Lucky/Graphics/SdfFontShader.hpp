@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+
+#include <Lucky/Graphics/Color.hpp>
+#include <Lucky/Graphics/GraphicsDevice.hpp>
+#include <Lucky/Graphics/ShaderProgram.hpp>
+
+namespace Lucky
+{
+    // Shader for drawing Font's signed distance field entries at any size. Pass the shader
+    // program to BatchRenderer::Begin together with the entry's texture. It outputs
+    // premultiplied alpha, so draw with BlendMode::PremultipliedAlpha.
+    //
+    // Outline and glow widths are in distance field units: 0.5 reaches from the glyph's
+    // edge to the end of the field, which is the entry's padding in pixels at its font size.
+    struct SdfFontShader
+    {
+      public:
+        SdfFontShader(std::shared_ptr<GraphicsDevice> graphicsDevice);
+        SdfFontShader(const SdfFontShader &) = delete;
+        ~SdfFontShader();
+
+        SdfFontShader &operator=(const SdfFontShader &) = delete;
+
+        std::shared_ptr<ShaderProgram> GetShaderProgram() const
+        {
+            return shaderProgram;
+        }
+
+        void SetOutline(float width, const Color &color);
+        void SetGlow(float width, const Color &color);
+
+      private:
+        std::shared_ptr<ShaderProgram> shaderProgram;
+    };
+} // namespace Lucky
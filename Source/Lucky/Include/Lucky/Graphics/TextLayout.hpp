@@ -0,0 +1,157 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Lucky/Graphics/BatchRenderer.hpp>
+#include <Lucky/Graphics/Color.hpp>
+#include <Lucky/Math/Vertex.hpp>
+
+namespace Lucky
+{
+    class Font;
+    struct GlyphCache;
+
+    enum class TextAlignment
+    {
+        Left,
+        Center,
+        Right,
+    };
+
+    struct TextBounds
+    {
+        float left = 0.0f;
+        float top = 0.0f;
+        float width = 0.0f;
+        float height = 0.0f;
+    };
+
+    // Where Font::LayoutString placed one glyph
+    struct GlyphPosition
+    {
+        // index of the glyph's code point in the decoded text
+        uint32_t index;
+        int codePoint;
+
+        // pen position on the baseline and how far the glyph moves it
+        float x, y;
+        float advance;
+
+        // the glyph's quad, empty for glyphs like spaces that don't draw anything
+        float left, top, right, bottom;
+    };
+
+    struct TextLayoutOptions
+    {
+        // Lines are aligned inside [0, maximumWidth] when wrapping, otherwise around x = 0
+        TextAlignment alignment = TextAlignment::Left;
+
+        // Wraps lines at spaces so they fit, 0 only breaks lines at '\n'
+        float maximumWidth = 0.0f;
+
+        // Multiplier for the font's line height
+        float lineSpacing = 1.0f;
+
+        // Size to draw the entry at, 0 uses the entry's own size
+        float fontSize = 0.0f;
+
+        bool operator==(const TextLayoutOptions &other) const
+        {
+            return alignment == other.alignment && maximumWidth == other.maximumWidth &&
+                   lineSpacing == other.lineSpacing && fontSize == other.fontSize;
+        }
+    };
+
+    // A string shaped once by Font::LayoutText into quads relative to the first line's
+    // baseline, so drawing it again is a copy into the batch instead of glyph lookups,
+    // kerning and line breaking.
+    //
+    // Vertices hold the entry's texture coordinates, so the batch has to be started with the
+    // entry's textures. Layouts of dynamic entries go stale when their glyph cache evicts,
+    // Font::IsLayoutCurrent tells when they need to be laid out again. Drawing one touches the
+    // shelves its glyphs are on, so the cache keeps them until the batch is drawn.
+    struct TextLayout
+    {
+      public:
+        void Draw(BatchRenderer &batchRenderer, float x, float y, const Color &color) const;
+
+        // Six vertices per visible glyph
+        std::vector<Vertex> vertices;
+
+        // a dynamic entry's glyph cache and the shelves of the glyphs in vertices
+        std::shared_ptr<GlyphCache> glyphCache;
+        std::vector<uint32_t> shelves;
+
+        // Relative to the first line's baseline, from the top of the first line to the bottom of
+        // the last, using the font's ascent and descent
+        TextBounds bounds;
+
+        float lineHeight = 0.0f;
+        uint32_t lineCount = 0;
+
+        // the entry's state when this was laid out
+        uint64_t generation = 0;
+    };
+
+    // Keeps recently used layouts keyed by font, entry, text and options, so static text like
+    // HUD labels is only laid out again after it's evicted or its entry's glyphs change.
+    struct TextLayoutCache
+    {
+      public:
+        TextLayoutCache(uint32_t capacity = 256);
+        TextLayoutCache(const TextLayoutCache &) = delete;
+        ~TextLayoutCache();
+
+        TextLayoutCache &operator=(const TextLayoutCache &) = delete;
+
+        // The reference stays valid until the layout is evicted, so draw it before asking for more
+        // layouts than the capacity
+        const TextLayout &Get(Font &font, const std::string &text, const std::string &entryName,
+            const TextLayoutOptions &options = TextLayoutOptions());
+
+        // Flushes the batch and lays the text out again if glyphs it needs couldn't be added
+        // while the batch held the glyph cache
+        void Draw(BatchRenderer &batchRenderer, Font &font, const std::string &text, const std::string &entryName,
+            float x, float y, const Color &color, const TextLayoutOptions &options = TextLayoutOptions());
+
+        void Clear();
+
+        uint32_t GetCount() const
+        {
+            return (uint32_t)entries.size();
+        }
+
+        uint32_t GetLayoutCount() const
+        {
+            return layoutCount;
+        }
+
+      private:
+        struct CacheEntry
+        {
+            const Font *font;
+            std::string entryName;
+            std::string text;
+            TextLayoutOptions options;
+            TextLayout layout;
+            std::list<size_t>::iterator lruPosition;
+        };
+
+        uint32_t capacity;
+
+        // layouts built by the cache, misses and stale layouts
+        uint32_t layoutCount = 0;
+
+        // keyed by a hash of the font, entry, text and options, a different string with the same
+        // hash just replaces the entry
+        std::unordered_map<size_t, CacheEntry> entries;
+
+        // most recently used at the front
+        std::list<size_t> lru;
+    };
+} // namespace Lucky
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <Lucky/Graphics/BatchRenderer.hpp>
+#include <Lucky/Graphics/Color.hpp>
+#include <Lucky/Graphics/TextLayout.hpp>
+#include <Lucky/Math/Vertex.hpp>
+
+namespace Lucky
+{
+    class Font;
+    struct GlyphCache;
+
+    // Editable text wrapped into lines by Font::LayoutParagraph, for chat windows, logs and text
+    // inputs. Edits only mark the text they touch, so laying out again after typing a character
+    // only wraps the few lines around it no matter how long the text is.
+    //
+    // Positions are code point indices. Lines, carets and drawing are relative to the first
+    // line's baseline and reflect the last layout, so lay the paragraph out after editing it.
+    struct TextParagraph
+    {
+      public:
+        struct Line
+        {
+            // code points [first, last) are on the line, the '\n' or space it broke at isn't
+            uint32_t first;
+            uint32_t last;
+            uint32_t next;
+            float width;
+
+            // x of the caret in front of each code point from first to last, the final one is
+            // the end of the line
+            std::vector<float> carets;
+
+            // quads relative to the line's baseline, already aligned
+            std::vector<Vertex> vertices;
+
+            // glyph cache shelves of a dynamic entry's glyphs in vertices
+            std::vector<uint32_t> shelves;
+        };
+
+        TextParagraph();
+        TextParagraph(const std::string &text);
+        ~TextParagraph();
+
+        void SetText(const std::string &text);
+        void Insert(uint32_t index, const std::string &text);
+        void Erase(uint32_t index, uint32_t count);
+
+        std::string GetText() const;
+
+        uint32_t GetLength() const
+        {
+            return (uint32_t)codePoints.size();
+        }
+
+        const std::vector<int> &GetCodePoints() const
+        {
+            return codePoints;
+        }
+
+        const std::vector<Line> &GetLines() const
+        {
+            return lines;
+        }
+
+        float GetLineHeight() const
+        {
+            return lineHeight;
+        }
+
+        float GetHeight() const
+        {
+            return lines.empty() ? 0.0f : (lines.size() - 1) * lineHeight + lineBottom - lineTop;
+        }
+
+        // Lines wrapped by the last layout, the rest were kept
+        uint32_t GetWrappedLineCount() const
+        {
+            return wrappedLineCount;
+        }
+
+        // The line a caret at index is on
+        uint32_t FindLine(uint32_t index) const;
+
+        // The caret at index, x along the line and y its baseline
+        glm::vec2 GetCaretPosition(uint32_t index) const;
+
+        // The caret closest to a point, like a mouse click
+        uint32_t FindIndex(float x, float y) const;
+
+        void Draw(BatchRenderer &batchRenderer, float x, float y, const Color &color) const;
+
+        // Only draws lines that overlap top to bottom, which are in the same space as x and y
+        void Draw(BatchRenderer &batchRenderer, float x, float y, const Color &color, float top, float bottom) const;
+
+      private:
+        friend class Font;
+
+        void MarkDirty(uint32_t start, uint32_t end);
+        void DrawLine(BatchRenderer &batchRenderer, size_t index, float x, float y, const Color &color) const;
+
+        std::vector<int> codePoints;
+        std::vector<Line> lines;
+
+        std::string entryName;
+        TextLayoutOptions options;
+
+        // set for dynamic entries, drawing touches the lines' shelves so the batch keeps them
+        std::shared_ptr<GlyphCache> glyphCache;
+        uint64_t generation = 0;
+        float lineHeight = 0.0f;
+
+        // a line's top and bottom relative to its baseline, the font's ascent and descent
+        float lineTop = 0.0f;
+        float lineBottom = 0.0f;
+
+        // code points edited since the last layout
+        bool dirty = false;
+        uint32_t dirtyStart = 0;
+        uint32_t dirtyEnd = 0;
+
+        uint32_t wrappedLineCount = 0;
+    };
+} // namespace Lucky
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace Lucky
 {
@@ -23,15 +24,25 @@ namespace Lucky
         HDR,
     };
 
+    // How alpha in loaded image files is handled. Straight uploads the pixels
+    // untouched, Premultiplied converts them for BlendMode::PremultipliedAlpha.
+    enum class TextureAlphaMode
+    {
+        Straight,
+        Premultiplied,
+    };
+
     struct GraphicsDevice;
 
     struct Texture
     {
       public:
         Texture(const std::string &filename, TextureFilter textureFilter = TextureFilter::Linear,
-            TextureFormat textureFormat = TextureFormat::Normal);
+            TextureFormat textureFormat = TextureFormat::Normal,
+            TextureAlphaMode alphaMode = TextureAlphaMode::Straight);
         Texture(uint8_t *memory, uint32_t memoryLength, TextureFilter textureFilter = TextureFilter::Linear,
-            TextureFormat textureFormat = TextureFormat::Normal);
+            TextureFormat textureFormat = TextureFormat::Normal,
+            TextureAlphaMode alphaMode = TextureAlphaMode::Straight);
         Texture(TextureType textureType, uint32_t width, uint32_t height, uint8_t *pixelData, uint32_t dataLength,
             TextureFilter textureFilter = TextureFilter::Linear, TextureFormat textureFormat = TextureFormat::Normal);
         Texture(const Texture &) = delete;
@@ -41,6 +52,46 @@ namespace Lucky
 
         void SetTextureData(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t *pixelData, uint32_t dataLength);
 
+        // Staged updates: regions are collected and uploaded together through a pixel buffer
+        // object by FlushTextureUpdates. pixelData points at the region's top left pixel inside
+        // an image that is rowStride pixels wide, and must stay valid until the flush.
+        // Overlapping or touching regions from the same image are merged before uploading.
+        void QueueTextureData(
+            uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t *pixelData, uint32_t rowStride);
+        void FlushTextureUpdates();
+
+        bool HasPendingUpdates() const
+        {
+            return !pendingUpdates.empty();
+        }
+
+        // A BatchRenderer holds its textures from Begin until the quads batched with them are
+        // drawn. The batch serial changes whenever the last holder lets go, so a serial recorded
+        // while the texture was held means its quads are still waiting to be drawn as long as the
+        // texture is held and the serial is unchanged.
+        void HoldForBatch()
+        {
+            batchHolds++;
+        }
+
+        void ReleaseFromBatch()
+        {
+            if (--batchHolds == 0)
+            {
+                batchSerial++;
+            }
+        }
+
+        bool IsHeldForBatch() const
+        {
+            return batchHolds > 0;
+        }
+
+        uint64_t GetBatchSerial() const
+        {
+            return batchSerial;
+        }
+
         TextureFilter GetTextureFilter() const
         {
             return textureFilter;
@@ -53,6 +104,11 @@ namespace Lucky
             return textureType;
         }
 
+        TextureFormat GetTextureFormat() const
+        {
+            return textureFormat;
+        }
+
         uint32_t GetWidth() const
         {
             return width;
@@ -73,15 +129,36 @@ namespace Lucky
             return fbo;
         }
 
+        // Approximate GPU memory used by the texture's pixel storage
+        uint64_t GetMemorySize() const;
+
+        static uint32_t BytesPerPixel(TextureFormat textureFormat);
+
       private:
+        struct PendingUpdate
+        {
+            uint32_t x, y, w, h;
+            const uint8_t *pixelData;
+            uint32_t rowStride;
+        };
+
+        void CoalescePendingUpdates();
+
         void Initialize(TextureType textureType, uint32_t width, uint32_t height, uint8_t *pixelData,
             uint32_t dataLength, TextureFilter textureFilter, TextureFormat textureFormat);
 
         TextureFilter textureFilter = TextureFilter::Linear;
         TextureType textureType = TextureType::Default;
+        TextureFormat textureFormat = TextureFormat::Normal;
         uint32_t width = 0;
         uint32_t height = 0;
         uint32_t textureId = 0;
         uint32_t fbo = 0;
+        uint32_t pbo = 0;
+
+        std::vector<PendingUpdate> pendingUpdates;
+
+        uint32_t batchHolds = 0;
+        uint64_t batchSerial = 0;
     };
 } // namespace Lucky
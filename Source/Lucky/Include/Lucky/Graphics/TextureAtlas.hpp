@@ -1,12 +1,14 @@
 #pragma once
 
-#include <map>
 #include <memory>
 #include <stdint.h>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <glm/glm.hpp>
 
+#include <Lucky/Graphics/Texture.hpp>
 #include <Lucky/Math/Rectangle.hpp>
 
 namespace Lucky
@@ -22,26 +24,93 @@ namespace Lucky
         glm::vec2 pivot;
 
         bool rotated;
+
+        // index of the atlas page (texture) that holds this region
+        uint32_t page;
     };
 
+    // Compact index of a region within its atlas. Resolve a name once with
+    // GetRegionId and use the id for per-frame lookups.
+    typedef uint32_t TextureRegionId;
+
+    constexpr TextureRegionId InvalidTextureRegionId = UINT32_MAX;
+
+    // Atlases can be loaded from TexturePacker JSON (array or hash format) or from
+    // Lucky's binary atlas format, which is detected by its header. The binary
+    // format is a header, an array of fixed size little endian region records, a
+    // page table and a string table holding the region names and image paths, so
+    // loading it needs no parsing, just a copy of each record. ConvertToBinary
+    // produces it from a JSON atlas.
+    //
+    // Multipack atlases have one page per texture. Both TexturePacker's multipack
+    // output (one JSON file per page, linked by meta.related_multi_packs) and the
+    // single file "textures" array layout are supported.
     struct TextureAtlas
     {
       public:
+        static void ConvertToBinary(const std::string &jsonFileName, const std::string &binaryFileName);
+
         TextureAtlas(const std::string &fileName);
         TextureAtlas(uint8_t *buffer, uint64_t bufferLength, const std::string &fileName = "");
 
-        bool Contains(const std::string &textureName) const;
-        TextureRegion GetRegion(const std::string &textureName) const;
+        void SaveBinary(const std::string &fileName) const;
+
+        bool Contains(std::string_view textureName) const;
+        const TextureRegion &GetRegion(std::string_view textureName) const;
+
+        // Returns InvalidTextureRegionId if the atlas doesn't contain the name
+        TextureRegionId GetRegionId(std::string_view textureName) const;
+
+        const TextureRegion &GetRegion(TextureRegionId regionId) const
+        {
+            return regions[regionId];
+        }
+
+        const std::string &GetRegionName(TextureRegionId regionId) const
+        {
+            return regionNames[regionId];
+        }
 
-        const std::string &TexturePath() const
+        uint32_t GetRegionCount() const
         {
-            return texturePath;
+            return (uint32_t)regions.size();
         }
 
+        uint32_t GetPageCount() const
+        {
+            return (uint32_t)texturePaths.size();
+        }
+
+        const std::string &TexturePath(uint32_t page = 0) const
+        {
+            return texturePaths[page];
+        }
+
+        // Loads every page's texture. Images are decoded on worker threads, only the
+        // texture creation happens on the calling thread.
+        std::vector<std::shared_ptr<Texture>> LoadPageTextures(TextureFilter textureFilter = TextureFilter::Linear,
+            TextureFormat textureFormat = TextureFormat::Normal,
+            TextureAlphaMode alphaMode = TextureAlphaMode::Straight) const;
+
       private:
-        void Initialize(uint8_t *buffer, uint64_t bufferLength, const std::string &fileName);
+        struct JsonHandler;
+
+        void InitializeJson(
+            char *buffer, uint64_t bufferLength, bool insitu, const std::string &fileName, bool loadRelatedPacks);
+        void InitializeBinary(const uint8_t *buffer, uint64_t bufferLength, const std::string &fileName);
+
+        void AddRegion(std::string_view textureName, const TextureRegion &textureRegion);
+        void GrowLookupTable();
+
+        // one entry per page
+        std::vector<std::string> texturePaths;
+        std::vector<std::string> imageNames;
+
+        std::vector<TextureRegion> regions;
+        std::vector<std::string> regionNames;
+        std::vector<uint32_t> regionHashes;
 
-        std::string texturePath;
-        std::map<std::string, TextureRegion> dictionary;
+        // open addressing with linear probing, each slot holds a region id or InvalidTextureRegionId
+        std::vector<TextureRegionId> lookupTable;
     };
 } // namespace Lucky
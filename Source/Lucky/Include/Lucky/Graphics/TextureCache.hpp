@@ -0,0 +1,119 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Lucky/Graphics/Texture.hpp>
+
+namespace Lucky
+{
+    // Loads textures by path and keeps their total size under a memory budget.
+    //
+    // Textures are evicted least recently used first, but only when they are
+    // not pinned and nothing outside the cache is still holding a reference.
+    // An evicted texture is reloaded from disk the next time it's requested,
+    // so callers should ask the cache for a texture when they need it rather
+    // than holding on to the shared_ptr indefinitely.
+    struct TextureCache
+    {
+      public:
+        TextureCache(uint64_t budgetBytes);
+        TextureCache(const TextureCache &) = delete;
+        ~TextureCache();
+
+        TextureCache &operator=(const TextureCache &) = delete;
+
+        // Asking for a texture in a different format or alpha mode than the cached one reloads it.
+        // That isn't counted as an eviction, and the old texture's bytes stay in the resident
+        // totals while something outside the cache still holds it.
+        std::shared_ptr<Texture> Get(const std::string &fileName, TextureFilter textureFilter = TextureFilter::Linear,
+            TextureFormat textureFormat = TextureFormat::Normal,
+            TextureAlphaMode alphaMode = TextureAlphaMode::Straight);
+
+        bool Contains(const std::string &fileName) const;
+        bool IsResident(const std::string &fileName) const;
+
+        // Pinned textures are never evicted, pinning a non-resident texture loads it
+        void Pin(const std::string &fileName, TextureFilter textureFilter = TextureFilter::Linear,
+            TextureFormat textureFormat = TextureFormat::Normal,
+            TextureAlphaMode alphaMode = TextureAlphaMode::Straight);
+        void Unpin(const std::string &fileName);
+
+        void Remove(const std::string &fileName);
+        void Clear();
+
+        // Evict unused textures until the cache is under budget
+        void Trim();
+
+        void SetBudget(uint64_t budgetBytes);
+
+        uint64_t GetBudget() const
+        {
+            return budgetBytes;
+        }
+
+        uint64_t GetResidentBytes() const
+        {
+            return residentBytes;
+        }
+
+        uint64_t GetResidentBytes(TextureFormat textureFormat) const;
+
+        uint32_t GetResidentCount() const
+        {
+            return residentCount;
+        }
+
+        uint32_t GetEvictionCount() const
+        {
+            return evictionCount;
+        }
+
+      private:
+        struct CacheEntry
+        {
+            std::string fileName;
+            TextureFilter textureFilter;
+            TextureFormat textureFormat;
+            TextureAlphaMode alphaMode;
+            bool pinned;
+            uint64_t bytes;
+            std::shared_ptr<Texture> texture;
+            std::list<CacheEntry *>::iterator lruPosition;
+        };
+
+        CacheEntry &Load(const std::string &fileName, TextureFilter textureFilter, TextureFormat textureFormat,
+            TextureAlphaMode alphaMode);
+        void Touch(CacheEntry &entry);
+        void Evict(CacheEntry &entry);
+        void Replace(CacheEntry &entry);
+        void ReleaseReplaced();
+
+        static constexpr int formatCount = 2;
+
+        uint64_t budgetBytes;
+        uint64_t residentBytes = 0;
+        uint64_t formatBytes[formatCount] = {};
+        uint32_t residentCount = 0;
+        uint32_t evictionCount = 0;
+
+        std::unordered_map<std::string, CacheEntry> entries;
+
+        // most recently used at the front, only resident textures are listed
+        std::list<CacheEntry *> lru;
+
+        // textures reloaded in another format that callers still hold, counted until released
+        struct ReplacedTexture
+        {
+            std::shared_ptr<Texture> texture;
+            uint64_t bytes;
+            TextureFormat textureFormat;
+        };
+
+        std::vector<ReplacedTexture> replaced;
+    };
+} // namespace Lucky
@@ -7,5 +7,8 @@ namespace Lucky
         float x, y;
         float u, v;
         float r, g, b, a;
+
+        // which of the batch's textures to sample, only read by multi-texture shaders
+        float textureIndex;
     };
 } // namespace Lucky
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace Lucky
+{
+    // Number of operator new calls made so far on the calling thread, for checking that code which
+    // shouldn't touch the heap doesn't. Debug builds replace the global operator new and delete,
+    // sized and aligned forms included, to count, so a program that replaces them itself must not
+    // link this. Release builds don't count and always return 0.
+    uint64_t GetThreadAllocationCount();
+} // namespace Lucky
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+namespace Lucky
+{
+    // Fixed size queue handing values from one thread to another without locking. Only one thread
+    // may push and only one may pop, either side can check the count.
+    template <typename T>
+    struct SpscQueue
+    {
+      public:
+        // Capacity is rounded up to a power of two
+        SpscQueue(uint32_t capacity = 1024)
+        {
+            uint32_t size = 1;
+            while (size < capacity)
+            {
+                size <<= 1;
+            }
+
+            items.resize(size);
+            mask = size - 1;
+        }
+
+        SpscQueue(const SpscQueue &) = delete;
+        SpscQueue &operator=(const SpscQueue &) = delete;
+
+        // Returns false without blocking when the queue is full
+        bool Push(const T &value)
+        {
+            uint32_t position = tail.load(std::memory_order_relaxed);
+            if (position - head.load(std::memory_order_acquire) > mask)
+            {
+                return false;
+            }
+
+            items[position & mask] = value;
+            tail.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Returns false without blocking when the queue is empty
+        bool Pop(T &value)
+        {
+            uint32_t position = head.load(std::memory_order_relaxed);
+            if (position == tail.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+
+            value = items[position & mask];
+            head.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Pushes as many of the count values as fit and returns how many that was
+        uint32_t Push(const T *values, uint32_t count)
+        {
+            uint32_t position = tail.load(std::memory_order_relaxed);
+            uint32_t space = mask + 1 - (position - head.load(std::memory_order_acquire));
+            count = std::min(count, space);
+
+            // the free space may wrap around the end of items
+            uint32_t start = position & mask;
+            uint32_t firstPart = std::min(count, mask + 1 - start);
+            std::copy(values, values + firstPart, items.begin() + start);
+            std::copy(values + firstPart, values + count, items.begin());
+
+            tail.store(position + count, std::memory_order_release);
+            return count;
+        }
+
+        // Pops up to count values and returns how many there were
+        uint32_t Pop(T *values, uint32_t count)
+        {
+            uint32_t position = head.load(std::memory_order_relaxed);
+            count = std::min(count, tail.load(std::memory_order_acquire) - position);
+
+            uint32_t start = position & mask;
+            uint32_t firstPart = std::min(count, mask + 1 - start);
+            std::copy(items.begin() + start, items.begin() + start + firstPart, values);
+            std::copy(items.begin(), items.begin() + (count - firstPart), values + firstPart);
+
+            head.store(position + count, std::memory_order_release);
+            return count;
+        }
+
+        // Drops up to count values without copying them out and returns how many there were
+        uint32_t Discard(uint32_t count)
+        {
+            uint32_t position = head.load(std::memory_order_relaxed);
+            count = std::min(count, tail.load(std::memory_order_acquire) - position);
+            head.store(position + count, std::memory_order_release);
+            return count;
+        }
+
+        uint32_t GetCount() const
+        {
+            return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+        }
+
+        // Running totals that wrap around, the pusher can note GetPushedCount and later compare it
+        // with GetPoppedCount to tell when everything it pushed so far has been taken
+        uint32_t GetPushedCount() const
+        {
+            return tail.load(std::memory_order_acquire);
+        }
+
+        uint32_t GetPoppedCount() const
+        {
+            return head.load(std::memory_order_acquire);
+        }
+
+        uint32_t GetCapacity() const
+        {
+            return mask + 1;
+        }
+
+      private:
+        std::vector<T> items;
+        uint32_t mask;
+
+        // on separate cache lines so the two threads don't keep stealing one from each other
+        alignas(64) std::atomic<uint32_t> head{0};
+        alignas(64) std::atomic<uint32_t> tail{0};
+    };
+} // namespace Lucky
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Lucky
+{
+    // Code point malformed UTF-8 decodes to
+    constexpr int ReplacementCharacter = 0xFFFD;
+
+    // Decodes the code point starting at text[position] and moves position past it. Invalid
+    // sequences, overlong encodings and surrogates decode to ReplacementCharacter one byte at a time.
+    int DecodeUtf8(const std::string &text, size_t &position);
+
+    // Appends the code points of the whole string to output, copying runs of ASCII 16 bytes at a time
+    void DecodeUtf8(const std::string &text, std::vector<int> &output);
+
+    // Appends the UTF-8 encoding of codePoint to output
+    void EncodeUtf8(int codePoint, std::string &output);
+} // namespace Lucky
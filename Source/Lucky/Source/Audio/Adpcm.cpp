@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <assert.h>
+
+#include <Lucky/Audio/Adpcm.hpp>
+
+namespace Lucky
+{
+    static const int16_t StepTable[89] = {7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+        45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371,
+        408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499,
+        2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635,
+        13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+    static const int8_t IndexTable[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+    struct AdpcmChannel
+    {
+        int32_t predictor;
+        int32_t stepIndex;
+
+        // the encoder runs this too so both sides stay in step
+        inline int16_t Decode(uint8_t code)
+        {
+            int32_t step = StepTable[stepIndex];
+            int32_t difference = step >> 3;
+            if (code & 4)
+            {
+                difference += step;
+            }
+            if (code & 2)
+            {
+                difference += step >> 1;
+            }
+            if (code & 1)
+            {
+                difference += step >> 2;
+            }
+
+            predictor += (code & 8) ? -difference : difference;
+            predictor = std::clamp(predictor, -32768, 32767);
+            stepIndex = std::clamp(stepIndex + IndexTable[code], 0, 88);
+
+            return (int16_t)predictor;
+        }
+
+        inline uint8_t Encode(int16_t sample)
+        {
+            int32_t step = StepTable[stepIndex];
+            int32_t delta = sample - predictor;
+
+            uint8_t code = 0;
+            if (delta < 0)
+            {
+                code = 8;
+                delta = -delta;
+            }
+
+            for (uint8_t bit = 4; bit > 0; bit >>= 1)
+            {
+                if (delta >= step)
+                {
+                    code |= bit;
+                    delta -= step;
+                }
+                step >>= 1;
+            }
+
+            Decode(code);
+            return code;
+        }
+    };
+
+    void EncodeAdpcm(const int16_t *samples, uint32_t frameCount, uint16_t channels, std::vector<uint8_t> &output)
+    {
+        assert(samples != nullptr || frameCount == 0);
+
+        const uint32_t codeBytes = (AdpcmBlockFrames - 1) / 2;
+        const uint32_t blockCount = (frameCount + AdpcmBlockFrames - 1) / AdpcmBlockFrames;
+
+        size_t first = output.size();
+        output.resize(first + (size_t)blockCount * GetAdpcmBlockSize(channels), 0);
+
+        // the step index carries over from block to block, the predictor restarts on each one
+        std::vector<AdpcmChannel> states(channels, AdpcmChannel{0, 0});
+
+        for (uint32_t block = 0; block < blockCount; block++)
+        {
+            uint8_t *header = &output[first + (size_t)block * GetAdpcmBlockSize(channels)];
+            uint8_t *codes = header + channels * 4;
+            uint32_t blockFirst = block * AdpcmBlockFrames;
+            uint32_t blockFrames = std::min(AdpcmBlockFrames, frameCount - blockFirst);
+
+            for (uint16_t c = 0; c < channels; c++)
+            {
+                AdpcmChannel &state = states[c];
+                int16_t firstSample = samples[(size_t)blockFirst * channels + c];
+                state.predictor = firstSample;
+
+                header[c * 4] = (uint8_t)(firstSample & 0xFF);
+                header[c * 4 + 1] = (uint8_t)((uint16_t)firstSample >> 8);
+                header[c * 4 + 2] = (uint8_t)state.stepIndex;
+
+                uint8_t *channelCodes = codes + c * codeBytes;
+                for (uint32_t i = 1; i < blockFrames; i++)
+                {
+                    uint8_t code = state.Encode(samples[(size_t)(blockFirst + i) * channels + c]);
+                    channelCodes[(i - 1) / 2] |= ((i - 1) & 1) ? code << 4 : code;
+                }
+            }
+        }
+    }
+
+    void DecodeAdpcm(
+        const uint8_t *blocks, uint16_t channels, uint32_t firstFrame, uint32_t frameCount, int16_t *output)
+    {
+        assert(blocks != nullptr || frameCount == 0);
+
+        const uint32_t codeBytes = (AdpcmBlockFrames - 1) / 2;
+
+        while (frameCount > 0)
+        {
+            uint32_t block = firstFrame / AdpcmBlockFrames;
+            uint32_t offset = firstFrame % AdpcmBlockFrames;
+            uint32_t count = std::min(frameCount, AdpcmBlockFrames - offset);
+
+            const uint8_t *header = blocks + (size_t)block * GetAdpcmBlockSize(channels);
+            const uint8_t *codes = header + channels * 4;
+
+            for (uint16_t c = 0; c < channels; c++)
+            {
+                AdpcmChannel state;
+                state.predictor = (int16_t)(header[c * 4] | (header[c * 4 + 1] << 8));
+                state.stepIndex = header[c * 4 + 2];
+
+                int16_t *out = output + c;
+                if (offset == 0)
+                {
+                    *out = (int16_t)state.predictor;
+                    out += channels;
+                }
+
+                // frames before offset still have to be decoded to reach the ones wanted
+                const uint8_t *channelCodes = codes + c * codeBytes;
+                for (uint32_t i = 1; i < offset + count; i++)
+                {
+                    uint8_t code = (channelCodes[(i - 1) / 2] >> (((i - 1) & 1) * 4)) & 0xF;
+                    int16_t sample = state.Decode(code);
+                    if (i >= offset)
+                    {
+                        *out = sample;
+                        out += channels;
+                    }
+                }
+            }
+
+            output += (size_t)count * channels;
+            firstFrame += count;
+            frameCount -= count;
+        }
+    }
+} // namespace Lucky
@@ -0,0 +1,466 @@
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+
+#include <Lucky/Audio/AudioKernels.hpp>
+
+/* clang-format off */
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#include <emmintrin.h>
+	#define LUCKY_AUDIO_SSE2
+
+	// only when the whole build targets AVX2, there's no runtime dispatch
+	#if defined(__AVX2__)
+		#include <immintrin.h>
+		#define LUCKY_AUDIO_AVX2
+	#endif
+
+#elif defined(_M_ARM64) || defined(__aarch64__)
+	#include <arm_neon.h>
+	#define LUCKY_AUDIO_NEON
+
+#endif
+
+// every multiply and add is rounded on its own, fusing them into FMA where one version gets
+// fused and another doesn't would break the paths matching bit for bit
+#if defined(__clang__)
+	#pragma STDC FP_CONTRACT OFF
+#elif defined(_MSC_VER)
+	#pragma fp_contract(off)
+#elif defined(__GNUC__)
+	#pragma GCC optimize("fp-contract=off")
+#endif
+/* clang-format on */
+
+namespace Lucky
+{
+    // the scale is a power of two so converting either way is exact before rounding
+    constexpr float SampleToFloat = 1.0f / 32768.0f;
+    constexpr float FloatToSample = 32768.0f;
+
+    // max then min with the operands in this order gives the same answer as _mm_max_ps and
+    // _mm_min_ps for every input, NaN included
+    static inline float ClampSample(float value, float low, float high)
+    {
+        value = value > low ? value : low;
+        return value < high ? value : high;
+    }
+
+    // the vector paths work out frame i's gain the same way so they match exactly
+    static inline float RampGain(float startGain, float step, uint32_t frame)
+    {
+        return startGain + step * (float)frame;
+    }
+
+    static void ApplyGainRampFrom(float *frames, uint32_t first, uint32_t frameCount, float startGain, float step)
+    {
+        for (uint32_t i = first; i < frameCount; i++)
+        {
+            float gain = RampGain(startGain, step, i);
+            frames[i * 2] *= gain;
+            frames[i * 2 + 1] *= gain;
+        }
+    }
+
+    static void ApplyStereoGainScalar(float *frames, uint32_t frameCount, float leftGain, float rightGain)
+    {
+        for (uint32_t i = 0; i < frameCount; i++)
+        {
+            frames[i * 2] *= leftGain;
+            frames[i * 2 + 1] *= rightGain;
+        }
+    }
+
+    static void GetPanGains(float pan, float &leftGain, float &rightGain)
+    {
+        const float quarterPi = 0.785398163f;
+        float angle = (std::clamp(pan, -1.0f, 1.0f) + 1.0f) * quarterPi;
+        leftGain = std::clamp(cosf(angle) * 1.41421356f, 0.0f, 1.0f);
+        rightGain = std::clamp(sinf(angle) * 1.41421356f, 0.0f, 1.0f);
+    }
+
+    void ConvertToFloatScalar(const int16_t *input, float *output, uint32_t sampleCount)
+    {
+        assert((input != nullptr && output != nullptr) || sampleCount == 0);
+
+        for (uint32_t i = 0; i < sampleCount; i++)
+        {
+            output[i] = input[i] * SampleToFloat;
+        }
+    }
+
+    void ConvertToSamplesScalar(const float *input, int16_t *output, uint32_t sampleCount)
+    {
+        assert((input != nullptr && output != nullptr) || sampleCount == 0);
+
+        for (uint32_t i = 0; i < sampleCount; i++)
+        {
+            output[i] = (int16_t)lrintf(ClampSample(input[i] * FloatToSample, -32768.0f, 32767.0f));
+        }
+    }
+
+    void ApplyGainScalar(float *samples, uint32_t sampleCount, float gain)
+    {
+        assert(samples != nullptr || sampleCount == 0);
+
+        for (uint32_t i = 0; i < sampleCount; i++)
+        {
+            samples[i] *= gain;
+        }
+    }
+
+    void ApplyGainRampScalar(float *frames, uint32_t frameCount, float startGain, float endGain)
+    {
+        assert(frames != nullptr || frameCount == 0);
+
+        if (frameCount > 0)
+        {
+            ApplyGainRampFrom(frames, 0, frameCount, startGain, (endGain - startGain) / frameCount);
+        }
+    }
+
+    void PanStereoScalar(float *frames, uint32_t frameCount, float pan)
+    {
+        assert(frames != nullptr || frameCount == 0);
+
+        float leftGain, rightGain;
+        GetPanGains(pan, leftGain, rightGain);
+        ApplyStereoGainScalar(frames, frameCount, leftGain, rightGain);
+    }
+
+    void MixSamplesScalar(const int16_t *input, float *bus, uint32_t sampleCount, float gain)
+    {
+        assert((input != nullptr && bus != nullptr) || sampleCount == 0);
+
+        float scale = gain * SampleToFloat;
+        for (uint32_t i = 0; i < sampleCount; i++)
+        {
+            bus[i] += input[i] * scale;
+        }
+    }
+
+    void AccumulateSamplesScalar(const float *input, float *bus, uint32_t sampleCount)
+    {
+        assert((input != nullptr && bus != nullptr) || sampleCount == 0);
+
+        for (uint32_t i = 0; i < sampleCount; i++)
+        {
+            bus[i] += input[i];
+        }
+    }
+
+    void ClampSamplesScalar(float *samples, uint32_t sampleCount)
+    {
+        assert(samples != nullptr || sampleCount == 0);
+
+        for (uint32_t i = 0; i < sampleCount; i++)
+        {
+            samples[i] = ClampSample(samples[i], -1.0f, 1.0f);
+        }
+    }
+
+#if defined(LUCKY_AUDIO_SSE2)
+    // sign extends eight samples to two vectors of floats
+    static inline void WidenSamples(__m128i samples, __m128 &low, __m128 &high)
+    {
+        low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+        high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16));
+    }
+#endif
+
+    void ConvertToFloat(const int16_t *input, float *output, uint32_t sampleCount)
+    {
+        assert((input != nullptr && output != nullptr) || sampleCount == 0);
+
+        uint32_t i = 0;
+
+#if defined(LUCKY_AUDIO_AVX2)
+        const __m256 scale8 = _mm256_set1_ps(SampleToFloat);
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            __m256i samples = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(input + i)));
+            _mm256_storeu_ps(output + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale8));
+        }
+#endif
+#if defined(LUCKY_AUDIO_SSE2)
+        const __m128 scale = _mm_set1_ps(SampleToFloat);
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            __m128 low, high;
+            WidenSamples(_mm_loadu_si128((const __m128i *)(input + i)), low, high);
+            _mm_storeu_ps(output + i, _mm_mul_ps(low, scale));
+            _mm_storeu_ps(output + i + 4, _mm_mul_ps(high, scale));
+        }
+#elif defined(LUCKY_AUDIO_NEON)
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            int16x8_t samples = vld1q_s16(input + i);
+            vst1q_f32(output + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), SampleToFloat));
+            vst1q_f32(output + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), SampleToFloat));
+        }
+#endif
+
+        ConvertToFloatScalar(input + i, output + i, sampleCount - i);
+    }
+
+    void ConvertToSamples(const float *input, int16_t *output, uint32_t sampleCount)
+    {
+        assert((input != nullptr && output != nullptr) || sampleCount == 0);
+
+        uint32_t i = 0;
+
+        // clamped while still float, converting an out of range float gives INT32_MIN and
+        // a loud positive sample would come out as the most negative one
+#if defined(LUCKY_AUDIO_AVX2)
+        const __m256 scale8 = _mm256_set1_ps(FloatToSample);
+        const __m256 low8 = _mm256_set1_ps(-32768.0f);
+        const __m256 high8 = _mm256_set1_ps(32767.0f);
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            __m256 value = _mm256_mul_ps(_mm256_loadu_ps(input + i), scale8);
+            __m256i whole = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(value, low8), high8));
+            __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(whole), _mm256_extracti128_si256(whole, 1));
+            _mm_storeu_si128((__m128i *)(output + i), packed);
+        }
+#endif
+#if defined(LUCKY_AUDIO_SSE2)
+        const __m128 scale = _mm_set1_ps(FloatToSample);
+        const __m128 low = _mm_set1_ps(-32768.0f);
+        const __m128 high = _mm_set1_ps(32767.0f);
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            __m128 first = _mm_mul_ps(_mm_loadu_ps(input + i), scale);
+            __m128 second = _mm_mul_ps(_mm_loadu_ps(input + i + 4), scale);
+            __m128i firstWhole = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(first, low), high));
+            __m128i secondWhole = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(second, low), high));
+            _mm_storeu_si128((__m128i *)(output + i), _mm_packs_epi32(firstWhole, secondWhole));
+        }
+#elif defined(LUCKY_AUDIO_NEON)
+        const float32x4_t low = vdupq_n_f32(-32768.0f);
+        const float32x4_t high = vdupq_n_f32(32767.0f);
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            float32x4_t first = vmulq_n_f32(vld1q_f32(input + i), FloatToSample);
+            float32x4_t second = vmulq_n_f32(vld1q_f32(input + i + 4), FloatToSample);
+            int32x4_t firstWhole = vcvtnq_s32_f32(vminnmq_f32(vmaxnmq_f32(first, low), high));
+            int32x4_t secondWhole = vcvtnq_s32_f32(vminnmq_f32(vmaxnmq_f32(second, low), high));
+            vst1q_s16(output + i, vcombine_s16(vqmovn_s32(firstWhole), vqmovn_s32(secondWhole)));
+        }
+#endif
+
+        ConvertToSamplesScalar(input + i, output + i, sampleCount - i);
+    }
+
+    void ApplyGain(float *samples, uint32_t sampleCount, float gain)
+    {
+        assert(samples != nullptr || sampleCount == 0);
+
+        uint32_t i = 0;
+
+#if defined(LUCKY_AUDIO_AVX2)
+        const __m256 gain8 = _mm256_set1_ps(gain);
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            _mm256_storeu_ps(samples + i, _mm256_mul_ps(_mm256_loadu_ps(samples + i), gain8));
+        }
+#endif
+#if defined(LUCKY_AUDIO_SSE2)
+        const __m128 gain4 = _mm_set1_ps(gain);
+        for (; i + 4 <= sampleCount; i += 4)
+        {
+            _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), gain4));
+        }
+#elif defined(LUCKY_AUDIO_NEON)
+        for (; i + 4 <= sampleCount; i += 4)
+        {
+            vst1q_f32(samples + i, vmulq_n_f32(vld1q_f32(samples + i), gain));
+        }
+#endif
+
+        ApplyGainScalar(samples + i, sampleCount - i, gain);
+    }
+
+    void ApplyGainRamp(float *frames, uint32_t frameCount, float startGain, float endGain)
+    {
+        assert(frames != nullptr || frameCount == 0);
+
+        if (frameCount == 0)
+        {
+            return;
+        }
+
+        float step = (endGain - startGain) / frameCount;
+        uint32_t i = 0;
+
+        // frame numbers are whole floats well below 2^24, adding to them is exact
+#if defined(LUCKY_AUDIO_AVX2)
+        const __m256 start8 = _mm256_set1_ps(startGain);
+        const __m256 step8 = _mm256_set1_ps(step);
+        const __m256 offsets8 = _mm256_setr_ps(0, 0, 1, 1, 2, 2, 3, 3);
+        for (; i + 4 <= frameCount; i += 4)
+        {
+            __m256 frame = _mm256_add_ps(_mm256_set1_ps((float)i), offsets8);
+            __m256 gain = _mm256_add_ps(start8, _mm256_mul_ps(step8, frame));
+            _mm256_storeu_ps(frames + i * 2, _mm256_mul_ps(_mm256_loadu_ps(frames + i * 2), gain));
+        }
+#endif
+#if defined(LUCKY_AUDIO_SSE2)
+        const __m128 start = _mm_set1_ps(startGain);
+        const __m128 step4 = _mm_set1_ps(step);
+        const __m128 offsets = _mm_setr_ps(0, 0, 1, 1);
+        for (; i + 2 <= frameCount; i += 2)
+        {
+            __m128 frame = _mm_add_ps(_mm_set1_ps((float)i), offsets);
+            __m128 gain = _mm_add_ps(start, _mm_mul_ps(step4, frame));
+            _mm_storeu_ps(frames + i * 2, _mm_mul_ps(_mm_loadu_ps(frames + i * 2), gain));
+        }
+#elif defined(LUCKY_AUDIO_NEON)
+        const float offsetValues[4] = {0, 0, 1, 1};
+        const float32x4_t offsets = vld1q_f32(offsetValues);
+        for (; i + 2 <= frameCount; i += 2)
+        {
+            float32x4_t frame = vaddq_f32(vdupq_n_f32((float)i), offsets);
+            float32x4_t gain = vaddq_f32(vdupq_n_f32(startGain), vmulq_n_f32(frame, step));
+            vst1q_f32(frames + i * 2, vmulq_f32(vld1q_f32(frames + i * 2), gain));
+        }
+#endif
+
+        ApplyGainRampFrom(frames, i, frameCount, startGain, step);
+    }
+
+    void PanStereo(float *frames, uint32_t frameCount, float pan)
+    {
+        assert(frames != nullptr || frameCount == 0);
+
+        float leftGain, rightGain;
+        GetPanGains(pan, leftGain, rightGain);
+        uint32_t i = 0;
+
+#if defined(LUCKY_AUDIO_AVX2)
+        const __m256 gain8 = _mm256_setr_ps(leftGain, rightGain, leftGain, rightGain, leftGain, rightGain,
+            leftGain, rightGain);
+        for (; i + 4 <= frameCount; i += 4)
+        {
+            _mm256_storeu_ps(frames + i * 2, _mm256_mul_ps(_mm256_loadu_ps(frames + i * 2), gain8));
+        }
+#endif
+#if defined(LUCKY_AUDIO_SSE2)
+        const __m128 gain = _mm_setr_ps(leftGain, rightGain, leftGain, rightGain);
+        for (; i + 2 <= frameCount; i += 2)
+        {
+            _mm_storeu_ps(frames + i * 2, _mm_mul_ps(_mm_loadu_ps(frames + i * 2), gain));
+        }
+#elif defined(LUCKY_AUDIO_NEON)
+        const float gainValues[4] = {leftGain, rightGain, leftGain, rightGain};
+        const float32x4_t gain = vld1q_f32(gainValues);
+        for (; i + 2 <= frameCount; i += 2)
+        {
+            vst1q_f32(frames + i * 2, vmulq_f32(vld1q_f32(frames + i * 2), gain));
+        }
+#endif
+
+        ApplyStereoGainScalar(frames + i * 2, frameCount - i, leftGain, rightGain);
+    }
+
+    void MixSamples(const int16_t *input, float *bus, uint32_t sampleCount, float gain)
+    {
+        assert((input != nullptr && bus != nullptr) || sampleCount == 0);
+
+        float scale = gain * SampleToFloat;
+        uint32_t i = 0;
+
+        // multiply then add as separate steps, a fused multiply-add would round differently
+#if defined(LUCKY_AUDIO_AVX2)
+        const __m256 scale8 = _mm256_set1_ps(scale);
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            __m256i samples = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(input + i)));
+            __m256 scaled = _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale8);
+            _mm256_storeu_ps(bus + i, _mm256_add_ps(_mm256_loadu_ps(bus + i), scaled));
+        }
+#endif
+#if defined(LUCKY_AUDIO_SSE2)
+        const __m128 scale4 = _mm_set1_ps(scale);
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            __m128 low, high;
+            WidenSamples(_mm_loadu_si128((const __m128i *)(input + i)), low, high);
+            _mm_storeu_ps(bus + i, _mm_add_ps(_mm_loadu_ps(bus + i), _mm_mul_ps(low, scale4)));
+            _mm_storeu_ps(bus + i + 4, _mm_add_ps(_mm_loadu_ps(bus + i + 4), _mm_mul_ps(high, scale4)));
+        }
+#elif defined(LUCKY_AUDIO_NEON)
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            int16x8_t samples = vld1q_s16(input + i);
+            float32x4_t low = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), scale);
+            float32x4_t high = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), scale);
+            vst1q_f32(bus + i, vaddq_f32(vld1q_f32(bus + i), low));
+            vst1q_f32(bus + i + 4, vaddq_f32(vld1q_f32(bus + i + 4), high));
+        }
+#endif
+
+        MixSamplesScalar(input + i, bus + i, sampleCount - i, gain);
+    }
+
+    void AccumulateSamples(const float *input, float *bus, uint32_t sampleCount)
+    {
+        assert((input != nullptr && bus != nullptr) || sampleCount == 0);
+
+        uint32_t i = 0;
+
+#if defined(LUCKY_AUDIO_AVX2)
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            _mm256_storeu_ps(bus + i, _mm256_add_ps(_mm256_loadu_ps(bus + i), _mm256_loadu_ps(input + i)));
+        }
+#endif
+#if defined(LUCKY_AUDIO_SSE2)
+        for (; i + 4 <= sampleCount; i += 4)
+        {
+            _mm_storeu_ps(bus + i, _mm_add_ps(_mm_loadu_ps(bus + i), _mm_loadu_ps(input + i)));
+        }
+#elif defined(LUCKY_AUDIO_NEON)
+        for (; i + 4 <= sampleCount; i += 4)
+        {
+            vst1q_f32(bus + i, vaddq_f32(vld1q_f32(bus + i), vld1q_f32(input + i)));
+        }
+#endif
+
+        AccumulateSamplesScalar(input + i, bus + i, sampleCount - i);
+    }
+
+    void ClampSamples(float *samples, uint32_t sampleCount)
+    {
+        assert(samples != nullptr || sampleCount == 0);
+
+        uint32_t i = 0;
+
+#if defined(LUCKY_AUDIO_AVX2)
+        const __m256 low8 = _mm256_set1_ps(-1.0f);
+        const __m256 high8 = _mm256_set1_ps(1.0f);
+        for (; i + 8 <= sampleCount; i += 8)
+        {
+            __m256 value = _mm256_loadu_ps(samples + i);
+            _mm256_storeu_ps(samples + i, _mm256_min_ps(_mm256_max_ps(value, low8), high8));
+        }
+#endif
+#if defined(LUCKY_AUDIO_SSE2)
+        const __m128 low = _mm_set1_ps(-1.0f);
+        const __m128 high = _mm_set1_ps(1.0f);
+        for (; i + 4 <= sampleCount; i += 4)
+        {
+            _mm_storeu_ps(samples + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(samples + i), low), high));
+        }
+#elif defined(LUCKY_AUDIO_NEON)
+        // the nm forms return the number when one side is NaN, as the SSE2 path does here
+        const float32x4_t low = vdupq_n_f32(-1.0f);
+        const float32x4_t high = vdupq_n_f32(1.0f);
+        for (; i + 4 <= sampleCount; i += 4)
+        {
+            vst1q_f32(samples + i, vminnmq_f32(vmaxnmq_f32(vld1q_f32(samples + i), low), high));
+        }
+#endif
+
+        ClampSamplesScalar(samples + i, sampleCount - i);
+    }
+} // namespace Lucky
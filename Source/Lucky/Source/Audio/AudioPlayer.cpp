@@ -1,73 +1,102 @@
+#include <algorithm>
+#include <assert.h>
 #include <map>
+#include <string>
 #include <vector>
 
 #include <SDL3/SDL.h>
 #include <spdlog/spdlog.h>
 
+#include <Lucky/Audio/AudioKernels.hpp>
 #include <Lucky/Audio/AudioPlayer.hpp>
 #include <Lucky/Audio/Sound.hpp>
-#include <Lucky/Math/MathHelpers.hpp>
+#include <Lucky/Audio/StreamDecoder.hpp>
+#include <Lucky/Utility/AllocationCounter.hpp>
+#include <Lucky/Utility/SpscQueue.hpp>
 
 namespace Lucky
 {
+    // Groups mix in float stereo at their device's rate and hand SDL one stream to play
+    constexpr int MixChannels = 2;
+
+    // Extra source frames fed to a converter, its resampler holds some back to look ahead
+    constexpr uint32_t ConverterLookahead = 64;
+
+    // Groups mix this many frames at a time so their scratch buffers can be allocated up front
+    constexpr uint32_t MixBlockFrames = 1024;
+
+    // Source formats a group can mix at once and the most channels one can have, as SDL
+    constexpr uint32_t MaxMixSources = 16;
+    constexpr uint16_t MaxSourceChannels = 8;
+
+    // Instances are created and deleted on the game thread, the mixer only reads and writes the
+    // fields below its own comment. In Callback mode the two sides talk through the group's
+    // command queue and the finished queue.
     struct AudioInstance
     {
-        enum class PutFramesResult
+        AudioInstance(
+            bool shouldLoop, AudioState state, SoundGroupId group, uint16_t channels, uint32_t sampleRate)
+            : shouldLoop(shouldLoop),
+              state(state),
+              group(group),
+              channels(channels),
+              sampleRate(sampleRate)
         {
-            Success,
-            ExhaustingQueue,
-            Complete,
-            Error,
-        };
+        }
 
-        AudioInstance(AudioPlayer &player, bool shouldLoop, AudioState state, AudioRef ref, const std::string &group,
-            int16_t channels, int32_t sampleRate)
-            : player(player),
-              audioStream(nullptr),
-              shouldLoop(shouldLoop),
-              state(state),
-              ref(ref),
-              group(group)
+        virtual ~AudioInstance()
         {
-            SDL_AudioSpec sourceSpec{SDL_AUDIO_S16, channels, sampleRate};
+        }
 
-            audioStream = SDL_CreateAudioStream(&sourceSpec, nullptr);
-            if (!audioStream)
-            {
-                spdlog::error("Failed to create audio stream");
-            }
+        // Writes up to frameCount frames to buffer, fewer once an instance that doesn't loop runs out
+        virtual uint32_t GetFrames(int16_t *buffer, uint32_t frameCount) = 0;
 
-            if (state == AudioState::Playing)
-            {
-                SDL_BindAudioStream(player.GetGroupDeviceId(group), audioStream);
-            }
+        // Moves on frameCount frames without decoding them, returns fewer as GetFrames would
+        virtual uint32_t SkipFrames(uint32_t frameCount) = 0;
+
+        // Game thread, the instance has lost its voice or got one back
+        virtual void SetVirtual(bool isVirtual)
+        {
+            this->isVirtual = isVirtual;
         }
 
-        virtual ~AudioInstance()
+        // Safe to call from the game thread
+        virtual uint32_t GetUnderrunCount()
         {
-            if (audioStream)
-            {
-                SDL_DestroyAudioStream(audioStream);
-                audioStream = nullptr;
-            }
+            return 0;
         }
 
-        virtual uint32_t GetSampleRate() const = 0;
-        virtual PutFramesResult PutSamplesStream(uint32_t desiredFrameCount) = 0;
+        const bool shouldLoop;
 
-        AudioPlayer &player;
-        SDL_AudioStream *audioStream;
-        bool shouldLoop;
+        // game thread
         AudioState state;
-        AudioRef ref;
-        std::string group;
+        AudioRef ref = 0;
+        SoundGroupId group;
+        uint32_t slot = 0;
+
+        // voice limiting, later plays win ties
+        int priority = 0;
+        uint64_t playOrder = 0;
+        bool isVirtual = false;
+
+        // releasing list, and the command count to wait for before deleting
+        AudioInstance *nextReleasing = nullptr;
+        uint32_t releasePushedCount = 0;
+
+        const uint16_t channels;
+        const uint32_t sampleRate;
+
+        // mixer, voices are linked through the instances so the list never allocates
+        AudioInstance *nextVoice = nullptr;
+        bool mixPaused = false;
+        bool mixFinished = false;
+        bool mixVirtual = false;
     };
 
     struct SoundInstance : public AudioInstance
     {
-        SoundInstance(AudioPlayer &player, std::shared_ptr<Sound> sound, bool shouldLoop, AudioState state,
-            AudioRef ref, const std::string &group)
-            : AudioInstance(player, shouldLoop, state, ref, group, sound->channels, sound->sampleRate),
+        SoundInstance(std::shared_ptr<Sound> sound, bool shouldLoop, AudioState state, SoundGroupId group)
+            : AudioInstance(shouldLoop, state, group, sound->channels, sound->sampleRate),
               sound(sound),
               position(0)
         {
@@ -77,152 +106,756 @@ namespace Lucky
         {
         }
 
-        virtual uint32_t GetSampleRate() const
+        virtual uint32_t GetFrames(int16_t *buffer, uint32_t frameCount)
         {
-            return sound->sampleRate;
+            bool didLoop = false;
+            return sound->GetFrames(position, buffer, frameCount, shouldLoop ? &didLoop : nullptr);
         }
 
-        virtual PutFramesResult PutSamplesStream(uint32_t desiredFrameCount)
+        virtual uint32_t SkipFrames(uint32_t frameCount)
         {
-            if (!audioStream)
+            if (shouldLoop && sound->totalFrames > 0)
             {
-                spdlog::error("Attempted to put samples into a null audio stream");
-                return PutFramesResult::Error;
+                position = static_cast<uint32_t>((position + (uint64_t)frameCount) % sound->totalFrames);
+                return frameCount;
             }
 
-            int bytesQueued = SDL_GetAudioStreamQueued(audioStream);
-            uint32_t framesQueued = bytesQueued / sizeof(int16_t) / sound->channels;
-            uint32_t framesNeeded = desiredFrameCount - framesQueued;
+            uint32_t framesSkipped = std::min(frameCount, sound->totalFrames - position);
+            position += framesSkipped;
+            return framesSkipped;
+        }
+
+        std::shared_ptr<Sound> sound;
+        uint32_t position;
+    };
+
+    struct StreamInstance : public AudioInstance
+    {
+        StreamInstance(std::shared_ptr<Stream> stream, bool shouldLoop, AudioState state, SoundGroupId group,
+            StreamDecoder &streamDecoder)
+            : AudioInstance(shouldLoop, state, group, stream->channels, stream->sampleRate),
+              streamDecoder(streamDecoder),
+              decodedStream(streamDecoder.Add(std::make_unique<Stream>(*stream), shouldLoop))
+        {
+        }
 
-            if (framesQueued >= desiredFrameCount)
+        ~StreamInstance()
+        {
+            decodedStream->Cancel();
+        }
+
+        // the decoder thread handles looping, this only takes what it has decoded
+        virtual uint32_t GetFrames(int16_t *buffer, uint32_t frameCount)
+        {
+            return decodedStream->GetFrames(buffer, frameCount);
+        }
+
+        virtual uint32_t SkipFrames(uint32_t frameCount)
+        {
+            return decodedStream->SkipFrames(frameCount);
+        }
+
+        // a virtual stream isn't decoded, getting its voice back refills it straight away from
+        // where the mixer has skipped to
+        virtual void SetVirtual(bool isVirtual)
+        {
+            AudioInstance::SetVirtual(isVirtual);
+            decodedStream->SetPaused(isVirtual);
+            if (!isVirtual)
             {
-                return PutFramesResult::Success;
+                streamDecoder.Wake();
             }
+        }
 
-            std::vector<int16_t> workBuffer(framesNeeded * sound->channels, 0);
-            bool didLoop = false;
-            auto frameCount = sound->GetFrames(position, &workBuffer[0], framesNeeded, shouldLoop ? &didLoop : nullptr);
+        virtual uint32_t GetUnderrunCount()
+        {
+            return decodedStream->GetUnderrunCount();
+        }
 
-            if (frameCount == 0)
+        StreamDecoder &streamDecoder;
+        std::shared_ptr<DecodedStream> decodedStream;
+    };
+
+    // Instances sharing a source format are summed at their own rate and converted to the group's
+    // mix format together, so a hundred sounds at 22050 Hz cost one resampler rather than a hundred
+    struct MixSource
+    {
+        uint16_t channels = 0;
+        uint32_t sampleRate = 0;
+
+        // null when the source is already in the mix format and goes straight into the bus
+        SDL_AudioStream *converter = nullptr;
+
+        // source frames owed to virtual voices, in units of 1 / mix rate
+        uint32_t virtualRemainder = 0;
+    };
+
+    enum class AudioCommandType
+    {
+        AddSource,
+        Play,
+        Pause,
+        Resume,
+        Stop,
+        StopAll,
+        SetVolume,
+        Virtualize,
+        Realize,
+    };
+
+    struct AudioCommand
+    {
+        AudioCommandType type;
+        AudioInstance *instance;
+        float volume;
+
+        // only AddSource carries one
+        MixSource source = {};
+    };
+
+    struct SoundGroup
+    {
+        SoundGroup(uint32_t commandCapacity)
+            : commands(commandCapacity),
+              finished(commandCapacity),
+              frameBuffer(MixBlockFrames * MaxSourceChannels),
+              sourceBus(MixBlockFrames * MaxSourceChannels),
+              convertedBus(MixBlockFrames * MixChannels),
+              mixBus(MixBlockFrames * MixChannels)
+        {
+            sources.reserve(MaxMixSources);
+        }
+
+        SDL_AudioDeviceID audioDeviceId = 0;
+        SDL_AudioDeviceID logicalAudioDeviceId = 0;
+
+        SDL_AudioSpec mixSpec = {SDL_AUDIO_F32, MixChannels, 48000};
+        SDL_AudioStream *outputStream = nullptr;
+
+        // game thread to mixer
+        SpscQueue<AudioCommand> commands;
+
+        // mixer to game thread, instances the mixer is done with and that can be deleted
+        SpscQueue<AudioInstance *> finished;
+
+        // instances the mixer finished that commands already queued may still point at, deleted
+        // once the mixer has popped past their releasePushedCount
+        AudioInstance *releasing = nullptr;
+
+        // formats the game thread has made sources for, the sources themselves belong to the mixer
+        std::vector<std::pair<uint16_t, uint32_t>> sourceFormats;
+
+        // everything below belongs to the mixer
+        std::vector<MixSource> sources;
+        AudioInstance *voices = nullptr;
+        float mixVolume = 1.0f;
+
+        // volume the last block ended at, a change ramps from it over the next block so it
+        // doesn't click
+        float blockVolume = 1.0f;
+        bool blockWasSilent = true;
+
+        // sized for one block up front, mixing never allocates
+        std::vector<int16_t> frameBuffer;
+        std::vector<float> sourceBus;
+        std::vector<float> convertedBus;
+        std::vector<float> mixBus;
+
+        // Game thread. Fills source with a new source for the format when it doesn't have one yet,
+        // converter included so the mixer never has to create one, and leaves it empty otherwise.
+        // Returns false when the format can't be mixed.
+        bool CreateMixSource(uint16_t channels, uint32_t sampleRate, MixSource &source)
+        {
+            for (const auto &format : sourceFormats)
             {
-                SDL_FlushAudioStream(audioStream);
-                if (framesQueued == 0)
+                if (format.first == channels && format.second == sampleRate)
                 {
-                    return PutFramesResult::Complete;
+                    return true;
                 }
-
-                return PutFramesResult::ExhaustingQueue;
             }
 
-            float groupVolume = player.GetGroupVolume(group);
-            float defaultVolume = player.GetGroupVolume("default");
-            float volume = std::min(groupVolume, defaultVolume);
-
-            if (!ApproximatelyEqual(volume, 1.0f))
+            if (sourceFormats.size() == MaxMixSources)
             {
-                std::transform(workBuffer.begin(), workBuffer.end(), workBuffer.begin(),
-                    [volume](int16_t sample) -> int16_t { return (int16_t)(sample * volume); });
+                spdlog::error("Can't mix more than {} audio formats in one group", MaxMixSources);
+                return false;
             }
-            SDL_PutAudioStreamData(audioStream, &workBuffer[0], frameCount * sound->channels * sizeof(int16_t));
 
-            if (frameCount < framesNeeded)
+            if (channels != MixChannels || sampleRate != (uint32_t)mixSpec.freq)
             {
-                return PutFramesResult::ExhaustingQueue;
+                SDL_AudioSpec sourceSpec{SDL_AUDIO_F32, channels, (int)sampleRate};
+                source.converter = SDL_CreateAudioStream(&sourceSpec, &mixSpec);
+                if (!source.converter)
+                {
+                    spdlog::error(
+                        "Failed to create audio stream converting {} channels at {} Hz", channels, sampleRate);
+                    return false;
+                }
             }
-            return PutFramesResult::Success;
+
+            source.channels = channels;
+            source.sampleRate = sampleRate;
+            sourceFormats.emplace_back(channels, sampleRate);
+            return true;
         }
 
-        std::shared_ptr<Sound> sound;
-        uint32_t position;
-    };
+        void ApplyCommands()
+        {
+            AudioCommand command;
+            while (commands.Pop(command))
+            {
+                switch (command.type)
+                {
+                case AudioCommandType::AddSource:
+                    // reserved for MaxMixSources, which the game thread never goes over
+                    sources.push_back(command.source);
+                    break;
+                case AudioCommandType::Play:
+                    command.instance->nextVoice = voices;
+                    voices = command.instance;
+                    break;
+                case AudioCommandType::Pause:
+                    command.instance->mixPaused = true;
+                    break;
+                case AudioCommandType::Resume:
+                    command.instance->mixPaused = false;
+                    break;
+                case AudioCommandType::Stop:
+                    command.instance->mixFinished = true;
+                    break;
+                case AudioCommandType::StopAll:
+                    for (AudioInstance *voice = voices; voice; voice = voice->nextVoice)
+                    {
+                        voice->mixFinished = true;
+                    }
+                    break;
+                case AudioCommandType::SetVolume:
+                    mixVolume = command.volume;
+                    break;
+                case AudioCommandType::Virtualize:
+                    command.instance->mixVirtual = true;
+                    break;
+                case AudioCommandType::Realize:
+                    command.instance->mixVirtual = false;
+                    break;
+                }
+            }
+        }
 
-    struct StreamInstance : public AudioInstance
-    {
-        StreamInstance(AudioPlayer &player, std::shared_ptr<Stream> stream, bool shouldLoop, AudioState state,
-            AudioRef ref, const std::string &group)
-            : AudioInstance(player, shouldLoop, state, ref, group, stream->channels, stream->sampleRate),
-              stream(std::make_unique<Stream>(*stream))
+        // Hands finished voices back to the game thread, ones that don't fit in the queue wait
+        // for the next mix
+        void RetireVoices()
         {
+            AudioInstance **link = &voices;
+            while (*link)
+            {
+                // the game thread may delete a voice as soon as it's pushed
+                AudioInstance *voice = *link;
+                AudioInstance *nextVoice = voice->nextVoice;
+                if (voice->mixFinished && finished.Push(voice))
+                {
+                    *link = nextVoice;
+                }
+                else
+                {
+                    link = &voice->nextVoice;
+                }
+            }
         }
 
-        ~StreamInstance()
+        // Adds frameCount frames, at most MixBlockFrames, of the playing voices in the source's
+        // format to bus and returns how many voices were mixed
+        uint32_t MixVoices(const MixSource &source, float *bus, uint32_t frameCount)
         {
+            uint32_t mixedCount = 0;
+
+            for (AudioInstance *voice = voices; voice; voice = voice->nextVoice)
+            {
+                if (voice->mixPaused || voice->mixFinished || voice->mixVirtual ||
+                    voice->channels != source.channels || voice->sampleRate != source.sampleRate)
+                {
+                    continue;
+                }
+
+                uint32_t framesRead = voice->GetFrames(&frameBuffer[0], frameCount);
+                if (framesRead < frameCount && !voice->shouldLoop)
+                {
+                    voice->mixFinished = true;
+                }
+
+                MixSamples(&frameBuffer[0], bus, framesRead * source.channels, 1.0f);
+                mixedCount++;
+            }
+
+            return mixedCount;
         }
 
-        virtual uint32_t GetSampleRate() const
+        // Moves the source's virtual voices on by the time frameCount mix frames take
+        void SkipVirtualVoices(MixSource &source, uint32_t frameCount)
         {
-            return stream->sampleRate;
+            uint64_t owed = (uint64_t)frameCount * source.sampleRate + source.virtualRemainder;
+            uint32_t sourceFrames = static_cast<uint32_t>(owed / mixSpec.freq);
+            source.virtualRemainder = static_cast<uint32_t>(owed % mixSpec.freq);
+
+            for (AudioInstance *voice = voices; voice; voice = voice->nextVoice)
+            {
+                if (!voice->mixVirtual || voice->mixPaused || voice->mixFinished ||
+                    voice->channels != source.channels || voice->sampleRate != source.sampleRate)
+                {
+                    continue;
+                }
+
+                if (voice->SkipFrames(sourceFrames) < sourceFrames && !voice->shouldLoop)
+                {
+                    voice->mixFinished = true;
+                }
+            }
         }
 
-        virtual PutFramesResult PutSamplesStream(uint32_t desiredFrameCount)
+        // Mixes up to MixBlockFrames frames of every source into mixBus and returns whether there
+        // was anything to mix
+        bool MixBlock(uint32_t frameCount)
         {
-            if (!audioStream)
+            const uint32_t frameSize = sizeof(float) * MixChannels;
+            std::fill(mixBus.begin(), mixBus.begin() + frameCount * MixChannels, 0.0f);
+            bool mixedAnything = false;
+
+            for (MixSource &source : sources)
             {
-                spdlog::error("Attempted to put samples into a null audio stream");
-                return PutFramesResult::Error;
+                SkipVirtualVoices(source, frameCount);
+
+                if (!source.converter)
+                {
+                    mixedAnything |= MixVoices(source, &mixBus[0], frameCount) > 0;
+                    continue;
+                }
+
+                // feed the converter until it has the block ready, the resampler keeps a few
+                // frames back and a higher source rate needs more than a block's worth
+                uint32_t availableFrames = SDL_GetAudioStreamAvailable(source.converter) / frameSize;
+                while (availableFrames < frameCount)
+                {
+                    uint32_t sourceFrames = static_cast<uint32_t>(
+                        (uint64_t)(frameCount - availableFrames) * source.sampleRate / mixSpec.freq);
+                    sourceFrames = std::min(sourceFrames + ConverterLookahead, MixBlockFrames);
+
+                    uint32_t sampleCount = sourceFrames * source.channels;
+                    std::fill(sourceBus.begin(), sourceBus.begin() + sampleCount, 0.0f);
+                    if (MixVoices(source, &sourceBus[0], sourceFrames) == 0)
+                    {
+                        break;
+                    }
+
+                    SDL_PutAudioStreamData(source.converter, &sourceBus[0], (int)(sampleCount * sizeof(float)));
+                    availableFrames = SDL_GetAudioStreamAvailable(source.converter) / frameSize;
+                }
+
+                int bytesRead = SDL_GetAudioStreamData(source.converter, &convertedBus[0], frameCount * frameSize);
+                uint32_t samplesRead = bytesRead > 0 ? bytesRead / sizeof(float) : 0;
+                AccumulateSamples(&convertedBus[0], &mixBus[0], samplesRead);
+                mixedAnything |= samplesRead > 0;
             }
 
-            int bytesQueued = SDL_GetAudioStreamQueued(audioStream);
-            uint32_t framesQueued = bytesQueued / sizeof(int16_t) / stream->channels;
-            uint32_t framesNeeded = desiredFrameCount - framesQueued;
+            // the group volume goes on once everything is summed and converted, after silence
+            // there's nothing to ramp from
+            if (blockWasSilent || !mixedAnything)
+            {
+                blockVolume = mixVolume;
+            }
+            blockWasSilent = !mixedAnything;
 
-            if (framesQueued >= desiredFrameCount)
+            if (mixedAnything)
             {
-                return PutFramesResult::Success;
+                if (blockVolume != mixVolume)
+                {
+                    ApplyGainRamp(&mixBus[0], frameCount, blockVolume, mixVolume);
+                    blockVolume = mixVolume;
+                }
+                else
+                {
+                    ApplyGain(&mixBus[0], frameCount * MixChannels, mixVolume);
+                }
+
+                ClampSamples(&mixBus[0], frameCount * MixChannels);
             }
 
-            std::vector<int16_t> workBuffer(framesNeeded * stream->channels, 0);
-            bool didLoop = false;
-            auto frameCount = stream->GetFrames(&workBuffer[0], framesNeeded, shouldLoop ? &didLoop : nullptr);
+            return mixedAnything;
+        }
+
+        // Applies waiting commands and queues frameCount frames of the group's voices on its output
+        void Mix(uint32_t frameCount)
+        {
+            ApplyCommands();
 
-            if (frameCount == 0)
+            const uint32_t frameSize = sizeof(float) * MixChannels;
+            while (frameCount > 0)
             {
-                SDL_FlushAudioStream(audioStream);
-                if (framesQueued == 0)
+                uint32_t blockFrames = std::min(frameCount, MixBlockFrames);
+
+                // an idle group leaves its stream empty and the device plays silence
+                if (MixBlock(blockFrames))
                 {
-                    return PutFramesResult::Complete;
+                    SDL_PutAudioStreamData(outputStream, &mixBus[0], blockFrames * frameSize);
                 }
 
-                return PutFramesResult::ExhaustingQueue;
+                frameCount -= blockFrames;
             }
 
-            float groupVolume = player.GetGroupVolume(group);
-            float defaultVolume = player.GetGroupVolume("default");
-            float volume = std::min(groupVolume, defaultVolume);
+            RetireVoices();
+        }
+    };
+
+    // Runs on the device's audio thread with the output stream locked
+    static void SDLCALL MixGroupCallback(void *userdata, SDL_AudioStream *, int additionalAmount, int)
+    {
+        SoundGroup &soundGroup = *static_cast<SoundGroup *>(userdata);
+
+#if defined(_DEBUG)
+        uint64_t allocationCount = GetThreadAllocationCount();
+#endif
 
-            if (!ApproximatelyEqual(volume, 1.0f))
+        if (additionalAmount > 0)
+        {
+            soundGroup.Mix(additionalAmount / (sizeof(float) * MixChannels));
+        }
+
+#if defined(_DEBUG)
+        // the audio thread must never wait on the heap
+        assert(GetThreadAllocationCount() == allocationCount);
+#endif
+    }
+
+    static void OpenGroupOutput(SoundGroup &soundGroup, SDL_AudioDeviceID deviceId, const AudioMixSettings &settings)
+    {
+        // the hint is global, so whatever it was before goes back once the device is open
+        bool setSampleFrames = settings.mode == AudioMixMode::Callback && settings.bufferFrames > 0;
+        const char *previousHint = setSampleFrames ? SDL_GetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES) : nullptr;
+        bool hadSampleFrames = previousHint != nullptr;
+        std::string previousSampleFrames = hadSampleFrames ? previousHint : "";
+
+        if (setSampleFrames)
+        {
+            SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, std::to_string(settings.bufferFrames).c_str());
+        }
+
+        soundGroup.audioDeviceId = deviceId;
+        soundGroup.logicalAudioDeviceId = SDL_OpenAudioDevice(deviceId, nullptr);
+
+        if (hadSampleFrames)
+        {
+            SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, previousSampleFrames.c_str());
+        }
+        else if (setSampleFrames)
+        {
+            SDL_ResetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES);
+        }
+
+        if (soundGroup.logicalAudioDeviceId == 0)
+        {
+            spdlog::error("Failed to open audio device with DeviceID {}", deviceId);
+            throw;
+        }
+
+        // mix at the device's rate so the output stream only has to convert the sample format
+        SDL_AudioSpec deviceSpec;
+        if (SDL_GetAudioDeviceFormat(soundGroup.logicalAudioDeviceId, &deviceSpec, nullptr) == 0 &&
+            deviceSpec.freq > 0)
+        {
+            soundGroup.mixSpec.freq = deviceSpec.freq;
+        }
+
+        // nothing mixes until the stream is bound, so the voices still playing get converters for
+        // the new rate here and they go straight to the mixer's sources
+        for (AudioInstance *voice = soundGroup.voices; voice; voice = voice->nextVoice)
+        {
+            MixSource source;
+            voice->mixFinished |= !soundGroup.CreateMixSource(voice->channels, voice->sampleRate, source);
+            if (source.channels != 0)
             {
-                std::transform(workBuffer.begin(), workBuffer.end(), workBuffer.begin(),
-                    [volume](int16_t sample) -> int16_t { return (int16_t)(sample * volume); });
+                soundGroup.sources.push_back(source);
             }
-            SDL_PutAudioStreamData(audioStream, &workBuffer[0], frameCount * stream->channels * sizeof(int16_t));
+        }
 
-            if (frameCount < framesNeeded)
+        soundGroup.outputStream = SDL_CreateAudioStream(&soundGroup.mixSpec, nullptr);
+        if (!soundGroup.outputStream)
+        {
+            spdlog::error("Failed to create audio stream for DeviceID {}", deviceId);
+            throw;
+        }
+
+        if (settings.mode == AudioMixMode::Callback)
+        {
+            SDL_SetAudioStreamGetCallback(soundGroup.outputStream, MixGroupCallback, &soundGroup);
+        }
+
+        if (SDL_BindAudioStream(soundGroup.logicalAudioDeviceId, soundGroup.outputStream) != 0)
+        {
+            spdlog::error("Failed to bind audio stream to DeviceID {}", deviceId);
+            throw;
+        }
+    }
+
+    static void CloseGroupOutput(SoundGroup &soundGroup)
+    {
+        // destroying the output waits for a callback that's running, after that the mixer is idle
+        SDL_DestroyAudioStream(soundGroup.outputStream);
+        soundGroup.outputStream = nullptr;
+
+        // sources still queued are taken now so their converters go with the rest
+        soundGroup.ApplyCommands();
+
+        for (MixSource &source : soundGroup.sources)
+        {
+            if (source.converter)
             {
-                return PutFramesResult::ExhaustingQueue;
+                SDL_DestroyAudioStream(source.converter);
             }
-            return PutFramesResult::Success;
         }
+        soundGroup.sources.clear();
+        soundGroup.sourceFormats.clear();
 
-        std::unique_ptr<Stream> stream;
-    };
+        SDL_CloseAudioDevice(soundGroup.logicalAudioDeviceId);
+        soundGroup.logicalAudioDeviceId = 0;
+    }
 
-    struct SoundGroup
+    constexpr uint32_t NoSlot = UINT32_MAX;
+
+    // An AudioRef is the instance's slot in the low bits and the slot's generation above them
+    constexpr uint32_t SlotBits = 20;
+    constexpr uint32_t SlotMask = (1u << SlotBits) - 1;
+    constexpr uint32_t GenerationMask = UINT32_MAX >> SlotBits;
+
+    // Instances live in slots that are reused once they're released, so the table stops growing
+    // after the busiest moment and releasing an instance doesn't move any others. Each release
+    // bumps the slot's generation, which makes the refs handed out for it before go stale.
+    struct InstanceSlot
     {
-        SDL_AudioDeviceID audioDeviceId = 0;
-        SDL_AudioDeviceID logicalAudioDeviceId = 0;
-        float volume = 0;
+        std::unique_ptr<AudioInstance> instance;
+        uint32_t nextFree = NoSlot;
+        uint32_t generation = 1;
     };
 
     struct AudioPlayer::Impl
     {
-        AudioRef nextAudioRef;
         SoundGroupSettings defaultSoundGroupSettings;
+        AudioMixSettings mixSettings;
+
+        std::unique_ptr<StreamDecoder> streamDecoder;
+
+        // voice limiting is worked out again on the next Update whenever what's playing changes,
+        // the buffers are sized as instances and groups are added so Update doesn't allocate
+        bool voicesChanged = false;
+        uint64_t nextPlayOrder = 0;
+        uint32_t virtualVoiceCount = 0;
+        std::vector<AudioInstance *> rankedVoices;
+        std::vector<uint32_t> groupVoiceCounts;
+
+        std::vector<InstanceSlot> slots;
+        uint32_t firstFreeSlot = NoSlot;
 
-        std::vector<std::unique_ptr<AudioInstance>> instances;
-        std::map<std::string, SoundGroup> soundGroups;
+        // indexed by SoundGroupId, a destroyed group leaves a null for the next new one; groups
+        // are held by pointer since their output callbacks keep one
+        std::vector<std::unique_ptr<SoundGroup>> soundGroups;
+        std::vector<float> groupVolumes;
+        std::vector<uint32_t> groupVoiceLimits;
+        std::map<std::string, SoundGroupId> soundGroupIds;
 
-        float queueTime;
+        SoundGroup &GetGroup(SoundGroupId soundGroupId)
+        {
+            if (soundGroupId >= soundGroups.size() || !soundGroups[soundGroupId])
+            {
+                spdlog::error("Couldn't find audio group with id {}", soundGroupId);
+                throw;
+            }
+
+            return *soundGroups[soundGroupId];
+        }
+
+        SoundGroupId FindOrCreateGroup(AudioPlayer &player, const std::string &soundGroupName)
+        {
+            auto iterator = soundGroupIds.find(soundGroupName);
+            if (iterator != soundGroupIds.end())
+            {
+                return iterator->second;
+            }
+
+            return player.CreateSoundGroup(soundGroupName, defaultSoundGroupSettings);
+        }
+
+        AudioInstance *AddInstance(std::unique_ptr<AudioInstance> instance)
+        {
+            uint32_t slot = firstFreeSlot;
+            if (slot != NoSlot)
+            {
+                firstFreeSlot = slots[slot].nextFree;
+            }
+            else
+            {
+                slot = (uint32_t)slots.size();
+                if (slot > SlotMask)
+                {
+                    spdlog::error("Can't play more than {} sounds at once", SlotMask + 1);
+                    throw;
+                }
+                slots.emplace_back();
+            }
+
+            instance->slot = slot;
+            instance->ref = (slots[slot].generation << SlotBits) | slot;
+            instance->playOrder = nextPlayOrder++;
+            slots[slot].instance = std::move(instance);
+            rankedVoices.reserve(slots.size());
+            voicesChanged = true;
+            return slots[slot].instance.get();
+        }
+
+        void ReleaseInstance(AudioInstance *instance)
+        {
+            uint32_t index = instance->slot;
+            InstanceSlot &slot = slots[index];
+            slot.instance.reset();
+
+            // generation 0 is skipped when it wraps so no ref is ever 0
+            slot.generation = (slot.generation + 1) & GenerationMask;
+            slot.generation += slot.generation == 0;
+
+            slot.nextFree = firstFreeSlot;
+            firstFreeSlot = index;
+        }
+
+        AudioInstance *FindInstance(AudioRef audioRef)
+        {
+            uint32_t slot = audioRef & SlotMask;
+            if (slot >= slots.size() || slots[slot].generation != audioRef >> SlotBits)
+            {
+                return nullptr;
+            }
+
+            return slots[slot].instance.get();
+        }
+
+        void Send(SoundGroup &soundGroup, const AudioCommand &command)
+        {
+            if (soundGroup.commands.Push(command))
+            {
+                return;
+            }
+
+            // the mixer is behind, hold its stream's lock so it can't run and catch up for it
+            SDL_LockAudioStream(soundGroup.outputStream);
+            soundGroup.ApplyCommands();
+            soundGroup.commands.Push(command);
+            SDL_UnlockAudioStream(soundGroup.outputStream);
+        }
+
+        // Sends the group's mixer a source for the instance's format if it doesn't have one yet,
+        // returns false when the format can't be mixed
+        bool SendMixSource(SoundGroup &soundGroup, const AudioInstance &instance)
+        {
+            MixSource source;
+            if (!soundGroup.CreateMixSource(instance.channels, instance.sampleRate, source))
+            {
+                return false;
+            }
+
+            if (source.channels != 0)
+            {
+                Send(soundGroup, AudioCommand{AudioCommandType::AddSource, nullptr, 0.0f, source});
+            }
+
+            return true;
+        }
+
+        // the default group's volume caps every other group's
+        void SendVolume(SoundGroupId soundGroupId)
+        {
+            float volume = std::min(groupVolumes[soundGroupId], groupVolumes[DefaultSoundGroupId]);
+            Send(*soundGroups[soundGroupId], AudioCommand{AudioCommandType::SetVolume, nullptr, volume});
+        }
+
+        // Deletes the instances the group's mixer handed back once no queued command refers to them
+        void ReleaseFinished(SoundGroup &soundGroup)
+        {
+            AudioInstance *instance;
+            while (soundGroup.finished.Pop(instance))
+            {
+                voicesChanged = true;
+
+                // stopped instances don't get commands, so nothing after this count can name it
+                instance->state = AudioState::Stopped;
+                instance->releasePushedCount = soundGroup.commands.GetPushedCount();
+                instance->nextReleasing = soundGroup.releasing;
+                soundGroup.releasing = instance;
+            }
+
+            uint32_t poppedCount = soundGroup.commands.GetPoppedCount();
+            AudioInstance **link = &soundGroup.releasing;
+            while (*link)
+            {
+                AudioInstance *released = *link;
+                if ((int32_t)(poppedCount - released->releasePushedCount) < 0)
+                {
+                    link = &released->nextReleasing;
+                    continue;
+                }
+
+                *link = released->nextReleasing;
+                ReleaseInstance(released);
+            }
+        }
+
+        // Gives voices to the playing instances that rank highest within the limits and sends
+        // the rest virtual
+        void LimitVoices()
+        {
+            if (!voicesChanged)
+            {
+                return;
+            }
+            voicesChanged = false;
+
+            rankedVoices.clear();
+            for (InstanceSlot &slot : slots)
+            {
+                if (slot.instance && slot.instance->state == AudioState::Playing)
+                {
+                    rankedVoices.push_back(slot.instance.get());
+                }
+            }
+
+            std::sort(rankedVoices.begin(), rankedVoices.end(), [](AudioInstance *a, AudioInstance *b) {
+                return a->priority != b->priority ? a->priority > b->priority : a->playOrder > b->playOrder;
+            });
+
+            std::fill(groupVoiceCounts.begin(), groupVoiceCounts.end(), 0);
+            uint32_t voiceCount = 0;
+            virtualVoiceCount = 0;
+
+            for (AudioInstance *instance : rankedVoices)
+            {
+                SoundGroupId group = instance->group;
+                bool isAudible = std::min(groupVolumes[group], groupVolumes[DefaultSoundGroupId]) > 0.0f;
+                bool hasVoice = isAudible &&
+                                (mixSettings.maxVoices == 0 || voiceCount < mixSettings.maxVoices) &&
+                                (groupVoiceLimits[group] == 0 || groupVoiceCounts[group] < groupVoiceLimits[group]);
+
+                if (hasVoice)
+                {
+                    voiceCount++;
+                    groupVoiceCounts[group]++;
+                }
+                else
+                {
+                    virtualVoiceCount++;
+                }
+
+                if (instance->isVirtual == hasVoice)
+                {
+                    instance->SetVirtual(!hasVoice);
+                    AudioCommandType type = hasVoice ? AudioCommandType::Realize : AudioCommandType::Virtualize;
+                    Send(*soundGroups[group], AudioCommand{type, instance, 0.0f});
+                }
+            }
+        }
     };
 
     std::vector<AudioDevice> AudioPlayer::GetAudioOutputDevices()
@@ -242,239 +875,378 @@ namespace Lucky
         return audioDevices;
     }
 
-    AudioPlayer::AudioPlayer(SoundGroupSettings defaultSoundGroupSettings)
+    AudioPlayer::AudioPlayer(SoundGroupSettings defaultSoundGroupSettings, AudioMixSettings mixSettings)
         : pImpl(std::make_unique<Impl>())
     {
-        pImpl->nextAudioRef = 1;
         pImpl->defaultSoundGroupSettings = defaultSoundGroupSettings;
-        pImpl->queueTime = 1 / 30.0f;
+        pImpl->mixSettings = mixSettings;
+        pImpl->streamDecoder = std::make_unique<StreamDecoder>(mixSettings.streamLookahead);
 
         CreateSoundGroup("default", defaultSoundGroupSettings);
     }
 
     AudioPlayer::~AudioPlayer()
     {
-        pImpl->instances.clear();
-
-        for (auto const &i : pImpl->soundGroups)
+        for (auto &soundGroup : pImpl->soundGroups)
         {
-            SDL_CloseAudioDevice(i.second.logicalAudioDeviceId);
+            if (soundGroup)
+            {
+                CloseGroupOutput(*soundGroup);
+            }
         }
+
+        pImpl->slots.clear();
     }
 
-    void AudioPlayer::CreateSoundGroup(const std::string &soundGroupName, SoundGroupSettings settings)
+    SoundGroupId AudioPlayer::CreateSoundGroup(const std::string &soundGroupName, SoundGroupSettings settings)
     {
-        auto groupIterator = pImpl->soundGroups.find(soundGroupName);
-        if (groupIterator != pImpl->soundGroups.end())
+        SoundGroupId soundGroupId;
+
+        auto idIterator = pImpl->soundGroupIds.find(soundGroupName);
+        if (idIterator != pImpl->soundGroupIds.end())
         {
-            SoundGroup &soundGroup = groupIterator->second;
+            soundGroupId = idIterator->second;
+            SoundGroup &soundGroup = *pImpl->soundGroups[soundGroupId];
 
-            // if the device id is changing
-            //    create the new one
-            //    loop through all playing instances and rebind to the new one
-            //    destroy the old one
+            // if the device id is changing reopen the group's output on the new one, the mixer
+            // keeps its voices and gets new converters in case the rate differs
             if (soundGroup.audioDeviceId != settings.deviceId)
             {
-                SDL_AudioDeviceID newDeviceId = SDL_OpenAudioDevice(settings.deviceId, nullptr);
+                CloseGroupOutput(soundGroup);
+                OpenGroupOutput(soundGroup, settings.deviceId, pImpl->mixSettings);
+            }
+        }
+        else
+        {
+            auto freeGroup = std::find(pImpl->soundGroups.begin(), pImpl->soundGroups.end(), nullptr);
+            soundGroupId = (SoundGroupId)(freeGroup - pImpl->soundGroups.begin());
+            if (freeGroup == pImpl->soundGroups.end())
+            {
+                pImpl->soundGroups.emplace_back();
+                pImpl->groupVolumes.push_back(0.0f);
+                pImpl->groupVoiceLimits.push_back(0);
+                pImpl->groupVoiceCounts.push_back(0);
+            }
 
-                for (auto const &i : pImpl->instances)
-                {
-                    if (i->group == soundGroupName && i->state == AudioState::Playing)
-                    {
-                        SDL_UnbindAudioStream(i->audioStream);
-                        SDL_BindAudioStream(newDeviceId, i->audioStream);
-                    }
-                }
+            pImpl->soundGroups[soundGroupId] = std::make_unique<SoundGroup>(pImpl->mixSettings.commandCapacity);
+            pImpl->soundGroupIds[soundGroupName] = soundGroupId;
+            OpenGroupOutput(*pImpl->soundGroups[soundGroupId], settings.deviceId, pImpl->mixSettings);
+        }
 
-                SDL_CloseAudioDevice(soundGroup.logicalAudioDeviceId);
+        pImpl->groupVolumes[soundGroupId] = settings.volume;
+        pImpl->groupVoiceLimits[soundGroupId] = settings.maxVoices;
+        pImpl->voicesChanged = true;
 
-                soundGroup.audioDeviceId = settings.deviceId;
-                soundGroup.logicalAudioDeviceId = newDeviceId;
+        if (soundGroupId == DefaultSoundGroupId)
+        {
+            for (SoundGroupId i = 0; i < pImpl->soundGroups.size(); i++)
+            {
+                if (pImpl->soundGroups[i])
+                {
+                    pImpl->SendVolume(i);
+                }
             }
-
-            soundGroup.volume = settings.volume;
         }
         else
         {
-            SoundGroup soundGroup;
+            pImpl->SendVolume(soundGroupId);
+        }
+
+        return soundGroupId;
+    }
 
-            soundGroup.audioDeviceId = settings.deviceId;
-            soundGroup.logicalAudioDeviceId = SDL_OpenAudioDevice(settings.deviceId, nullptr);
-            if (soundGroup.logicalAudioDeviceId == 0)
+    void AudioPlayer::DestroySoundGroup(const std::string &soundGroupName)
+    {
+        auto idIterator = pImpl->soundGroupIds.find(soundGroupName);
+        if (idIterator != pImpl->soundGroupIds.end())
+        {
+            DestroySoundGroup(idIterator->second);
+        }
+    }
+
+    void AudioPlayer::DestroySoundGroup(SoundGroupId soundGroupId)
+    {
+        // once the output is gone nothing mixes the group's instances and they can go right away
+        CloseGroupOutput(pImpl->GetGroup(soundGroupId));
+        for (InstanceSlot &slot : pImpl->slots)
+        {
+            if (slot.instance && slot.instance->group == soundGroupId)
             {
-                spdlog::error("Failed to open audio device with DeviceID {}", settings.deviceId);
-                throw;
+                pImpl->ReleaseInstance(slot.instance.get());
+            }
+        }
+
+        pImpl->soundGroups[soundGroupId].reset();
+        pImpl->voicesChanged = true;
+        for (auto iterator = pImpl->soundGroupIds.begin(); iterator != pImpl->soundGroupIds.end(); ++iterator)
+        {
+            if (iterator->second == soundGroupId)
+            {
+                pImpl->soundGroupIds.erase(iterator);
+                break;
             }
-            soundGroup.volume = settings.volume;
-            pImpl->soundGroups[soundGroupName] = soundGroup;
         }
     }
 
-    void AudioPlayer::DestroySoundGroup(const std::string &soundGroupName)
+    SoundGroupId AudioPlayer::GetSoundGroupId(const std::string &soundGroupName)
     {
-        StopGroup(soundGroupName);
-
-        auto groupIterator = pImpl->soundGroups.find(soundGroupName);
-        if (groupIterator != pImpl->soundGroups.end())
+        auto iterator = pImpl->soundGroupIds.find(soundGroupName);
+        if (iterator == pImpl->soundGroupIds.end())
         {
-            SDL_CloseAudioDevice(groupIterator->second.logicalAudioDeviceId);
-            pImpl->soundGroups.erase(groupIterator);
+            spdlog::error("Couldn't find audio group named {}", soundGroupName);
+            throw;
         }
+
+        return iterator->second;
     }
 
     void AudioPlayer::StopGroup(const std::string &soundGroupName)
     {
-        pImpl->instances.erase(
-            std::remove_if(pImpl->instances.begin(), pImpl->instances.end(),
-                [soundGroupName](std::unique_ptr<AudioInstance> &ai) { return ai->group == soundGroupName; }),
-            pImpl->instances.end());
+        auto iterator = pImpl->soundGroupIds.find(soundGroupName);
+        if (iterator != pImpl->soundGroupIds.end())
+        {
+            StopGroup(iterator->second);
+        }
+    }
+
+    void AudioPlayer::StopGroup(SoundGroupId soundGroupId)
+    {
+        SoundGroup &soundGroup = pImpl->GetGroup(soundGroupId);
+
+        for (InstanceSlot &slot : pImpl->slots)
+        {
+            if (slot.instance && slot.instance->group == soundGroupId)
+            {
+                slot.instance->state = AudioState::Stopped;
+            }
+        }
+
+        pImpl->Send(soundGroup, AudioCommand{AudioCommandType::StopAll, nullptr, 0.0f});
+        pImpl->voicesChanged = true;
     }
 
     void AudioPlayer::PauseGroup(const std::string &soundGroupName)
     {
-        for (auto const &i : pImpl->instances)
+        auto iterator = pImpl->soundGroupIds.find(soundGroupName);
+        if (iterator != pImpl->soundGroupIds.end())
+        {
+            PauseGroup(iterator->second);
+        }
+    }
+
+    void AudioPlayer::PauseGroup(SoundGroupId soundGroupId)
+    {
+        for (InstanceSlot &slot : pImpl->slots)
         {
-            if (i->group == soundGroupName)
+            if (slot.instance && slot.instance->group == soundGroupId)
             {
-                Pause(i->ref);
+                Pause(slot.instance->ref);
             }
         }
     }
 
     void AudioPlayer::ResumeGroup(const std::string &soundGroupName)
     {
-        for (auto const &i : pImpl->instances)
+        auto iterator = pImpl->soundGroupIds.find(soundGroupName);
+        if (iterator != pImpl->soundGroupIds.end())
+        {
+            ResumeGroup(iterator->second);
+        }
+    }
+
+    void AudioPlayer::ResumeGroup(SoundGroupId soundGroupId)
+    {
+        for (InstanceSlot &slot : pImpl->slots)
         {
-            if (i->group == soundGroupName)
+            if (slot.instance && slot.instance->group == soundGroupId)
             {
-                Resume(i->ref);
+                Resume(slot.instance->ref);
             }
         }
     }
 
     SDL_AudioDeviceID AudioPlayer::GetGroupDeviceId(const std::string &soundGroupName)
     {
-        auto iterator = pImpl->soundGroups.find(soundGroupName);
-        if (iterator == pImpl->soundGroups.end())
-        {
-            spdlog::error("Couldn't find audio group named {}", soundGroupName);
-            throw;
-        }
+        return GetGroupDeviceId(GetSoundGroupId(soundGroupName));
+    }
 
-        return iterator->second.logicalAudioDeviceId;
+    SDL_AudioDeviceID AudioPlayer::GetGroupDeviceId(SoundGroupId soundGroupId)
+    {
+        return pImpl->GetGroup(soundGroupId).logicalAudioDeviceId;
     }
 
     float AudioPlayer::GetGroupVolume(const std::string &soundGroupName)
     {
-        auto iterator = pImpl->soundGroups.find(soundGroupName);
-        if (iterator == pImpl->soundGroups.end())
-        {
-            spdlog::error("Couldn't find audio group named {}", soundGroupName);
-            throw;
-        }
+        return GetGroupVolume(GetSoundGroupId(soundGroupName));
+    }
 
-        return iterator->second.volume;
+    float AudioPlayer::GetGroupVolume(SoundGroupId soundGroupId)
+    {
+        pImpl->GetGroup(soundGroupId);
+        return pImpl->groupVolumes[soundGroupId];
     }
 
-    AudioRef AudioPlayer::Play(std::shared_ptr<Sound> sound, const std::string &soundGroupName, const bool loop)
+    AudioRef AudioPlayer::Play(
+        std::shared_ptr<Sound> sound, const std::string &soundGroupName, const bool loop, const int priority)
     {
-        auto groupIterator = pImpl->soundGroups.find(soundGroupName);
-        if (groupIterator == pImpl->soundGroups.end())
-        {
-            CreateSoundGroup(soundGroupName, pImpl->defaultSoundGroupSettings);
-        }
+        return Play(sound, pImpl->FindOrCreateGroup(*this, soundGroupName), loop, priority);
+    }
+
+    AudioRef AudioPlayer::Play(
+        std::shared_ptr<Sound> sound, SoundGroupId soundGroupId, const bool loop, const int priority)
+    {
+        SoundGroup &soundGroup = pImpl->GetGroup(soundGroupId);
 
-        SoundGroup &soundGroup = pImpl->soundGroups[soundGroupName];
-        AudioRef audioRef = pImpl->nextAudioRef++;
+        AudioInstance *instance =
+            pImpl->AddInstance(std::make_unique<SoundInstance>(sound, loop, AudioState::Playing, soundGroupId));
+        instance->priority = priority;
 
-        pImpl->instances.push_back(
-            std::make_unique<SoundInstance>(*this, sound, loop, AudioState::Playing, audioRef, soundGroupName));
-        return audioRef;
+        // a format that can't be mixed goes straight back as finished
+        instance->mixFinished = !pImpl->SendMixSource(soundGroup, *instance);
+        pImpl->Send(soundGroup, AudioCommand{AudioCommandType::Play, instance, 0.0f});
+        return instance->ref;
     }
 
-    AudioRef AudioPlayer::Play(std::shared_ptr<Stream> stream, const std::string &soundGroupName, const bool loop)
+    AudioRef AudioPlayer::Play(
+        std::shared_ptr<Stream> stream, const std::string &soundGroupName, const bool loop, const int priority)
     {
-        auto groupIterator = pImpl->soundGroups.find(soundGroupName);
-        if (groupIterator == pImpl->soundGroups.end())
-        {
-            CreateSoundGroup(soundGroupName, pImpl->defaultSoundGroupSettings);
-        }
+        return Play(stream, pImpl->FindOrCreateGroup(*this, soundGroupName), loop, priority);
+    }
 
-        SoundGroup &soundGroup = pImpl->soundGroups[soundGroupName];
-        AudioRef audioRef = pImpl->nextAudioRef++;
+    AudioRef AudioPlayer::Play(
+        std::shared_ptr<Stream> stream, SoundGroupId soundGroupId, const bool loop, const int priority)
+    {
+        SoundGroup &soundGroup = pImpl->GetGroup(soundGroupId);
+
+        AudioInstance *instance =
+            pImpl->AddInstance(std::make_unique<StreamInstance>(
+                stream, loop, AudioState::Playing, soundGroupId, *pImpl->streamDecoder));
+        instance->priority = priority;
 
-        pImpl->instances.push_back(
-            std::make_unique<StreamInstance>(*this, stream, loop, AudioState::Playing, audioRef, soundGroupName));
-        return audioRef;
+        // a format that can't be mixed goes straight back as finished
+        instance->mixFinished = !pImpl->SendMixSource(soundGroup, *instance);
+        pImpl->Send(soundGroup, AudioCommand{AudioCommandType::Play, instance, 0.0f});
+        return instance->ref;
     }
 
     void AudioPlayer::Pause(const AudioRef &audioRef)
     {
-        auto iterator = std::find_if(pImpl->instances.begin(), pImpl->instances.end(),
-            [audioRef](std::unique_ptr<AudioInstance> &ai) { return ai->ref == audioRef; });
-        if (iterator == pImpl->instances.end() || (*iterator)->state == AudioState::Paused)
+        AudioInstance *instance = pImpl->FindInstance(audioRef);
+        if (!instance || instance->state != AudioState::Playing)
         {
             return;
         }
 
-        (*iterator)->state = AudioState::Paused;
-        SDL_UnbindAudioStream((*iterator)->audioStream);
+        instance->state = AudioState::Paused;
+        pImpl->Send(*pImpl->soundGroups[instance->group], AudioCommand{AudioCommandType::Pause, instance, 0.0f});
+        pImpl->voicesChanged = true;
     }
 
     void AudioPlayer::Resume(const AudioRef &audioRef)
     {
-        auto iterator = std::find_if(pImpl->instances.begin(), pImpl->instances.end(),
-            [audioRef](std::unique_ptr<AudioInstance> &ai) { return ai->ref == audioRef; });
-        if (iterator == pImpl->instances.end() || (*iterator)->state == AudioState::Playing)
+        AudioInstance *instance = pImpl->FindInstance(audioRef);
+        if (!instance || instance->state != AudioState::Paused)
         {
             return;
         }
 
-        (*iterator)->state = AudioState::Playing;
-        SDL_BindAudioStream((*iterator)->player.GetGroupDeviceId((*iterator)->group), (*iterator)->audioStream);
+        instance->state = AudioState::Playing;
+        pImpl->Send(*pImpl->soundGroups[instance->group], AudioCommand{AudioCommandType::Resume, instance, 0.0f});
+        pImpl->voicesChanged = true;
     }
 
     void AudioPlayer::Stop(const AudioRef &audioRef)
     {
-        auto iterator = std::find_if(pImpl->instances.begin(), pImpl->instances.end(),
-            [audioRef](std::unique_ptr<AudioInstance> &ai) { return ai->ref == audioRef; });
-        if (iterator == pImpl->instances.end())
+        AudioInstance *instance = pImpl->FindInstance(audioRef);
+        if (!instance || instance->state == AudioState::Stopped)
         {
             return;
         }
 
-        pImpl->instances.erase(iterator);
+        // the mixer may still hold it, it's deleted once it comes back through the finished queue
+        instance->state = AudioState::Stopped;
+        pImpl->Send(*pImpl->soundGroups[instance->group], AudioCommand{AudioCommandType::Stop, instance, 0.0f});
+        pImpl->voicesChanged = true;
     }
 
     AudioState AudioPlayer::GetState(const AudioRef &audioRef)
     {
-        auto iterator = std::find_if(pImpl->instances.begin(), pImpl->instances.end(),
-            [audioRef](std::unique_ptr<AudioInstance> &ai) { return ai->ref == audioRef; });
-        if (iterator == pImpl->instances.end())
+        AudioInstance *instance = pImpl->FindInstance(audioRef);
+        if (!instance)
         {
             return AudioState::Stopped;
         }
 
-        return (*iterator)->state;
+        return instance->state;
+    }
+
+    bool AudioPlayer::IsVirtual(const AudioRef &audioRef)
+    {
+        AudioInstance *instance = pImpl->FindInstance(audioRef);
+        return instance && instance->state != AudioState::Stopped && instance->isVirtual;
+    }
+
+    uint32_t AudioPlayer::GetVirtualVoiceCount()
+    {
+        return pImpl->virtualVoiceCount;
+    }
+
+    uint32_t AudioPlayer::GetUnderrunCount(const AudioRef &audioRef)
+    {
+        AudioInstance *instance = pImpl->FindInstance(audioRef);
+        if (!instance)
+        {
+            return 0;
+        }
+
+        return instance->GetUnderrunCount();
+    }
+
+    uint64_t AudioPlayer::GetStreamUnderrunCount()
+    {
+        return pImpl->streamDecoder->GetUnderrunCount();
     }
 
     void AudioPlayer::Update()
     {
-        for (auto &i : pImpl->instances)
+#if defined(_DEBUG)
+        uint64_t allocationCount = GetThreadAllocationCount();
+#endif
+
+        const uint32_t frameSize = sizeof(float) * MixChannels;
+
+        pImpl->LimitVoices();
+
+        for (auto &group : pImpl->soundGroups)
         {
-            if (i->state == AudioState::Playing)
+            if (!group)
+            {
+                continue;
+            }
+
+            SoundGroup &soundGroup = *group;
+
+            if (pImpl->mixSettings.mode == AudioMixMode::Polled)
             {
-                uint32_t sampleRate = i->GetSampleRate();
-                auto result = i->PutSamplesStream(static_cast<uint32_t>(pImpl->queueTime * sampleRate));
-                if (result == AudioInstance::PutFramesResult::Complete)
+                uint32_t queuedFrames = SDL_GetAudioStreamQueued(soundGroup.outputStream) / frameSize;
+                uint32_t targetFrames = static_cast<uint32_t>(pImpl->mixSettings.queueTime * soundGroup.mixSpec.freq);
+                if (queuedFrames < targetFrames)
                 {
-                    i->state = AudioState::Stopped;
+                    soundGroup.Mix(targetFrames - queuedFrames);
+                }
+                else
+                {
+                    soundGroup.ApplyCommands();
+                    soundGroup.RetireVoices();
                 }
             }
+
+            pImpl->ReleaseFinished(soundGroup);
         }
 
-        pImpl->instances.erase(std::remove_if(pImpl->instances.begin(), pImpl->instances.end(),
-                                   [](std::unique_ptr<AudioInstance> &ai) { return ai->state == AudioState::Stopped; }),
-            pImpl->instances.end());
+#if defined(_DEBUG)
+        // mixing and releasing instances only use memory allocated by Play and CreateSoundGroup
+        assert(GetThreadAllocationCount() == allocationCount);
+#endif
     }
 } // namespace Lucky
@@ -1,11 +1,13 @@
 #include <dr_wav.h>
 #include <spdlog/spdlog.h>
 
+#include <Lucky/Audio/Adpcm.hpp>
 #include <Lucky/Audio/Sound.hpp>
 
 namespace Lucky
 {
-    Sound::Sound(const std::string &filename)
+    Sound::Sound(const std::string &filename, SoundEncoding encoding)
+        : encoding(encoding)
     {
         unsigned int drwavChannels;
         unsigned int drwavSampleRate;
@@ -22,12 +24,13 @@ namespace Lucky
         totalFrames = static_cast<uint32_t>(drwavSampleCount);
         sampleRate = drwavSampleRate;
         channels = drwavChannels;
-        frames.insert(frames.end(), drwavSamples, drwavSamples + totalFrames * channels);
+        SetSamples(drwavSamples);
 
         drwav_free(drwavSamples, nullptr);
     }
 
-    Sound::Sound(void *buffer, uint32_t bufferByteSize)
+    Sound::Sound(void *buffer, uint32_t bufferByteSize, SoundEncoding encoding)
+        : encoding(encoding)
     {
         unsigned int drwavChannels;
         unsigned int drwavSampleRate;
@@ -44,11 +47,23 @@ namespace Lucky
         totalFrames = static_cast<uint32_t>(drwavSampleCount);
         sampleRate = drwavSampleRate;
         channels = drwavChannels;
-        frames.insert(frames.end(), drwavSamples, drwavSamples + totalFrames);
+        SetSamples(drwavSamples);
 
         drwav_free(drwavSamples, nullptr);
     }
 
+    void Sound::SetSamples(const int16_t *samples)
+    {
+        if (encoding == SoundEncoding::Adpcm)
+        {
+            EncodeAdpcm(samples, totalFrames, channels, blocks);
+        }
+        else
+        {
+            frames.insert(frames.end(), samples, samples + (size_t)totalFrames * channels);
+        }
+    }
+
     uint32_t Sound::GetFrames(uint32_t &position, int16_t *buffer, uint32_t frameCount, bool *loop)
     {
         uint32_t framesAvailable = totalFrames - position;
@@ -56,7 +71,15 @@ namespace Lucky
 
         if (framesToGet > 0)
         {
-            memcpy(buffer, &frames[position * channels], framesToGet * channels * sizeof(int16_t));
+            if (encoding == SoundEncoding::Adpcm)
+            {
+                DecodeAdpcm(&blocks[0], channels, position, framesToGet, buffer);
+            }
+            else
+            {
+                memcpy(buffer, &frames[position * channels], framesToGet * channels * sizeof(int16_t));
+            }
+
             position += framesToGet;
             if (position == totalFrames && loop)
             {
@@ -69,4 +92,9 @@ namespace Lucky
 
         return framesToGet;
     }
-} // namespace Lucky
\ No newline at end of file
+
+    size_t Sound::GetMemorySize() const
+    {
+        return frames.size() * sizeof(int16_t) + blocks.size();
+    }
+} // namespace Lucky
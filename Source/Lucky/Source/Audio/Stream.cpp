@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <fstream>
+#include <stdint.h>
+
 #include <Lucky/Audio/Stream.hpp>
 #include <spdlog/spdlog.h>
 
@@ -6,134 +10,78 @@ namespace Lucky
     Stream::Stream(const std::string &fileName)
         : sampleRate(0),
           channels(0),
-          streamSource(StreamSource::File),
           fileName(fileName),
           buffer(nullptr),
           bufferByteSize(0),
           vorbis(nullptr),
-          mp3(nullptr)
+          mp3(nullptr),
+          position(0),
+          seekPending(false),
+          frameCount(UINT64_MAX)
     {
-        vorbis = stb_vorbis_open_filename(fileName.c_str(), nullptr, nullptr);
-        if (vorbis)
+        std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+        if (!file)
         {
-            stb_vorbis_info info = stb_vorbis_get_info(vorbis);
-            sampleRate = info.sample_rate;
-            channels = info.channels;
+            spdlog::error("Couldn't open audio stream from file {}", fileName);
+            throw;
         }
-        else
+
+        auto data = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(data->data()), data->size());
+
+        fileData = data;
+        buffer = fileData->data();
+        bufferByteSize = static_cast<uint32_t>(fileData->size());
+
+        if (!Open(false))
         {
-            mp3 = new drmp3();
-            if (drmp3_init_file(mp3, fileName.c_str(), nullptr))
-            {
-                sampleRate = mp3->sampleRate;
-                channels = mp3->channels;
-            }
-            else
-            {
-                delete mp3;
-                spdlog::error("Couldn't open audio stream from file {}", fileName);
-                throw;
-            }
+            spdlog::error("Couldn't open audio stream from file {}", fileName);
+            throw;
         }
     }
 
     Stream::Stream(void *buffer, uint32_t bufferByteSize)
         : sampleRate(0),
           channels(0),
-          streamSource(StreamSource::Memory),
           buffer(buffer),
           bufferByteSize(bufferByteSize),
           vorbis(nullptr),
-          mp3(nullptr)
+          mp3(nullptr),
+          position(0),
+          seekPending(false),
+          frameCount(UINT64_MAX)
     {
-        vorbis = stb_vorbis_open_memory((const unsigned char *)buffer, bufferByteSize, nullptr, nullptr);
-        if (vorbis)
-        {
-            stb_vorbis_info info = stb_vorbis_get_info(vorbis);
-            sampleRate = info.sample_rate;
-            channels = info.channels;
-        }
-        else
+        if (!Open(false))
         {
-            mp3 = new drmp3();
-            if (drmp3_init_memory(mp3, buffer, bufferByteSize, nullptr))
-            {
-                sampleRate = mp3->sampleRate;
-                channels = mp3->channels;
-            }
-            else
-            {
-                delete mp3;
-                spdlog::error("Couldn't open audio stream from memory");
-                throw;
-            }
+            spdlog::error("Couldn't open audio stream from memory");
+            throw;
         }
     }
 
     Stream::Stream(const Stream &stream)
         : sampleRate(stream.sampleRate),
           channels(stream.channels),
-          streamSource(stream.streamSource),
           fileName(stream.fileName),
+          fileData(stream.fileData),
           buffer(stream.buffer),
           bufferByteSize(stream.bufferByteSize),
           vorbis(nullptr),
-          mp3(nullptr)
+          mp3(nullptr),
+          position(0),
+          seekPending(false),
+          frameCount(stream.frameCount)
     {
-        if (stream.vorbis)
+        if (!Open(stream.mp3 != nullptr))
         {
-            if (streamSource == StreamSource::File)
-            {
-                vorbis = stb_vorbis_open_filename(fileName.c_str(), nullptr, nullptr);
-                if (!vorbis)
-                {
-                    spdlog::error("Couldn't open audio stream from file {}", fileName);
-                    throw;
-                }
-            }
-            else
-            {
-                vorbis = stb_vorbis_open_memory((const unsigned char *)buffer, bufferByteSize, nullptr, nullptr);
-                if (!vorbis)
-                {
-                    spdlog::error("Couldn't open audio stream from memory");
-                    throw;
-                }
-            }
-            stb_vorbis_info info = stb_vorbis_get_info(vorbis);
-            if (channels != info.channels || sampleRate != info.sample_rate)
-            {
-                spdlog::error("Unexpected settings on cloned vorbis stream");
-                throw;
-            }
+            spdlog::error("Couldn't reopen audio stream {}", fileName);
+            throw;
         }
-        else
+
+        if (channels != stream.channels || sampleRate != stream.sampleRate)
         {
-            mp3 = new drmp3();
-            if (streamSource == StreamSource::File)
-            {
-                if (!drmp3_init_file(mp3, fileName.c_str(), nullptr))
-                {
-                    delete mp3;
-                    spdlog::error("Couldn't open audio stream from file {}", fileName);
-                    throw;
-                }
-            }
-            else
-            {
-                if (!drmp3_init_memory(mp3, buffer, bufferByteSize, nullptr))
-                {
-                    delete mp3;
-                    spdlog::error("Couldn't open audio stream from memory");
-                    throw;
-                }
-            }
-            if (channels != mp3->channels || sampleRate != mp3->sampleRate)
-            {
-                delete mp3;
-                spdlog::error("Unexpected settings on cloned mp3 stream");
-                throw;
-            }
+            spdlog::error("Unexpected settings on cloned audio stream {}", fileName);
+            throw;
         }
     }
 
@@ -152,6 +100,33 @@ namespace Lucky
         }
     }
 
+    bool Stream::Open(bool isMp3)
+    {
+        if (!isMp3)
+        {
+            vorbis = stb_vorbis_open_memory((const unsigned char *)buffer, bufferByteSize, nullptr, nullptr);
+            if (vorbis)
+            {
+                stb_vorbis_info info = stb_vorbis_get_info(vorbis);
+                sampleRate = info.sample_rate;
+                channels = info.channels;
+                return true;
+            }
+        }
+
+        mp3 = new drmp3();
+        if (!drmp3_init_memory(mp3, buffer, bufferByteSize, nullptr))
+        {
+            delete mp3;
+            mp3 = nullptr;
+            return false;
+        }
+
+        sampleRate = mp3->sampleRate;
+        channels = mp3->channels;
+        return true;
+    }
+
     uint32_t Stream::GetFrames(int16_t *buffer, uint32_t frames, bool *loop)
     {
         if (loop)
@@ -159,6 +134,25 @@ namespace Lucky
             *loop = false;
         }
 
+        if (seekPending)
+        {
+            // a skip that stopped right at the end leaves nothing to seek to or read
+            if (position >= GetFrameCount())
+            {
+                return 0;
+            }
+
+            bool sought = vorbis ? stb_vorbis_seek(vorbis, static_cast<unsigned int>(position)) != 0
+                                 : drmp3_seek_to_pcm_frame(mp3, position) != DRMP3_FALSE;
+            if (!sought)
+            {
+                spdlog::error("Failed to seek {} to frame {}", fileName, position);
+                return 0;
+            }
+
+            seekPending = false;
+        }
+
         if (vorbis)
         {
             uint32_t samples = static_cast<uint32_t>(
@@ -167,11 +161,15 @@ namespace Lucky
             {
                 *loop = true;
                 stb_vorbis_seek_start(vorbis);
-                return samples + stb_vorbis_get_samples_short_interleaved(
-                                     vorbis, channels, buffer + samples * channels, (frames - samples) * channels);
+                uint32_t loopSamples = static_cast<uint32_t>(stb_vorbis_get_samples_short_interleaved(
+                    vorbis, channels, buffer + samples * channels, (frames - samples) * channels));
+
+                position = loopSamples;
+                return samples + loopSamples;
             }
             else
             {
+                position += samples;
                 return samples;
             }
         }
@@ -182,16 +180,54 @@ namespace Lucky
             {
                 *loop = true;
                 drmp3_seek_to_pcm_frame(mp3, 0);
+                uint32_t loopSamples = static_cast<uint32_t>(
+                    drmp3_read_pcm_frames_s16(mp3, frames - samples, buffer + samples * channels));
 
-                return samples +
-                       static_cast<uint32_t>(drmp3_read_pcm_frames_s16(mp3, channels, buffer + samples * channels));
+                position = loopSamples;
+                return samples + loopSamples;
             }
             else
             {
+                position += samples;
                 return samples;
             }
         }
 
         return 0;
     }
+
+    uint32_t Stream::SkipFrames(uint32_t frames, bool loop)
+    {
+        uint64_t length = GetFrameCount();
+        uint64_t target = position + frames;
+        uint32_t framesSkipped = frames;
+
+        if (target >= length)
+        {
+            if (loop)
+            {
+                target = length > 0 ? target % length : 0;
+            }
+            else
+            {
+                framesSkipped = static_cast<uint32_t>(length - std::min(position, length));
+                target = length;
+            }
+        }
+
+        position = target;
+        seekPending = true;
+        return framesSkipped;
+    }
+
+    uint64_t Stream::GetFrameCount()
+    {
+        if (frameCount == UINT64_MAX)
+        {
+            // dr_mp3 counts by walking the frame headers and then seeks back to where it was
+            frameCount = vorbis ? stb_vorbis_stream_length_in_samples(vorbis) : drmp3_get_pcm_frame_count(mp3);
+        }
+
+        return frameCount;
+    }
 } // namespace Lucky
@@ -0,0 +1,42 @@
+#include <Lucky/Audio/StreamCache.hpp>
+
+namespace Lucky
+{
+    std::shared_ptr<Stream> StreamCache::Get(const std::string &fileName)
+    {
+        auto iterator = entries.find(fileName);
+        if (iterator != entries.end())
+        {
+            return iterator->second;
+        }
+
+        auto stream = std::make_shared<Stream>(fileName);
+        entries.emplace(fileName, stream);
+        residentBytes += stream->GetByteSize();
+
+        return stream;
+    }
+
+    bool StreamCache::Contains(const std::string &fileName) const
+    {
+        return entries.find(fileName) != entries.end();
+    }
+
+    void StreamCache::Remove(const std::string &fileName)
+    {
+        auto iterator = entries.find(fileName);
+        if (iterator == entries.end())
+        {
+            return;
+        }
+
+        residentBytes -= iterator->second->GetByteSize();
+        entries.erase(iterator);
+    }
+
+    void StreamCache::Clear()
+    {
+        entries.clear();
+        residentBytes = 0;
+    }
+} // namespace Lucky
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+#include <Lucky/Audio/StreamDecoder.hpp>
+
+namespace Lucky
+{
+    // Most frames decoded in one go, bounds the decoder's scratch buffer
+    constexpr uint32_t DecodeChunkFrames = 4096;
+
+    DecodedStream::DecodedStream(std::unique_ptr<Stream> stream, bool shouldLoop, uint32_t lookaheadFrames)
+        : channels(stream->channels),
+          stream(std::move(stream)),
+          shouldLoop(shouldLoop),
+          samples(std::max<uint32_t>(lookaheadFrames, 1) * channels)
+    {
+    }
+
+    uint32_t DecodedStream::GetFrames(int16_t *buffer, uint32_t frameCount)
+    {
+        // read before popping, once it's set everything the decoder will push is already there
+        bool hasEnded = ended.load(std::memory_order_acquire);
+
+        // the decoder only pushes whole frames so a pop never splits one
+        uint32_t sampleCount = frameCount * channels;
+        uint32_t samplesRead = samples.Pop(buffer, sampleCount);
+        if (samplesRead > 0)
+        {
+            resuming.store(false, std::memory_order_relaxed);
+        }
+
+        if (samplesRead == sampleCount || hasEnded)
+        {
+            return samplesRead / channels;
+        }
+
+        // an unpaused stream stays silent and keeps time until the decoder has caught it up
+        if (samplesRead == 0 && resuming.load(std::memory_order_relaxed))
+        {
+            owedFrames.fetch_add(frameCount, std::memory_order_relaxed);
+            memset(buffer, 0, sampleCount * sizeof(int16_t));
+            return frameCount;
+        }
+
+        // silence before the first decode is just the stream starting, not the decoder falling behind
+        if (started.load(std::memory_order_acquire))
+        {
+            underrunCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        memset(buffer + samplesRead, 0, (sampleCount - samplesRead) * sizeof(int16_t));
+        return frameCount;
+    }
+
+    uint32_t DecodedStream::SkipFrames(uint32_t frameCount)
+    {
+        bool hasEnded = ended.load(std::memory_order_acquire);
+
+        uint32_t framesSkipped = samples.Discard(frameCount * channels) / channels;
+        if (hasEnded)
+        {
+            return framesSkipped;
+        }
+
+        owedFrames.fetch_add(frameCount - framesSkipped, std::memory_order_relaxed);
+        return frameCount;
+    }
+
+    void DecodedStream::SetPaused(bool isPaused)
+    {
+        if (!isPaused && paused.load(std::memory_order_relaxed))
+        {
+            resuming.store(true, std::memory_order_relaxed);
+        }
+
+        paused.store(isPaused, std::memory_order_relaxed);
+    }
+
+    void DecodedStream::Decode(std::vector<int16_t> &scratch)
+    {
+        uint32_t scratchFrames = static_cast<uint32_t>(scratch.size() / channels);
+
+        while (!ended.load(std::memory_order_relaxed) && !IsCancelled())
+        {
+            // the mixer has gone past everything decoded, so the stream is moved on to where it is
+            uint32_t framesOwed = owedFrames.exchange(0, std::memory_order_relaxed);
+            if (framesOwed > 0 && stream->SkipFrames(framesOwed, shouldLoop) < framesOwed)
+            {
+                ended.store(true, std::memory_order_release);
+                return;
+            }
+
+            if (paused.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+
+            uint32_t freeFrames = (samples.GetCapacity() - samples.GetCount()) / channels;
+            uint32_t frameCount = std::min(freeFrames, scratchFrames);
+            if (frameCount == 0)
+            {
+                return;
+            }
+
+            bool didLoop = false;
+            uint32_t framesRead = stream->GetFrames(&scratch[0], frameCount, shouldLoop ? &didLoop : nullptr);
+            samples.Push(&scratch[0], framesRead * channels);
+            started.store(true, std::memory_order_release);
+
+            // a looping stream that reads nothing even after seeking back is empty
+            if ((framesRead < frameCount && !shouldLoop) || framesRead == 0)
+            {
+                ended.store(true, std::memory_order_release);
+            }
+        }
+    }
+
+    void DecodedStream::Cancel()
+    {
+        cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    bool DecodedStream::IsCancelled() const
+    {
+        return cancelled.load(std::memory_order_relaxed);
+    }
+
+    uint32_t DecodedStream::GetUnderrunCount() const
+    {
+        return underrunCount.load(std::memory_order_relaxed);
+    }
+
+    StreamDecoder::StreamDecoder(float lookahead)
+        : lookahead(lookahead)
+    {
+        thread = std::thread(&StreamDecoder::Run, this);
+    }
+
+    StreamDecoder::~StreamDecoder()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        wake.notify_one();
+        thread.join();
+    }
+
+    std::shared_ptr<DecodedStream> StreamDecoder::Add(std::unique_ptr<Stream> stream, bool shouldLoop)
+    {
+        uint32_t lookaheadFrames = static_cast<uint32_t>(lookahead * stream->sampleRate);
+        auto decodedStream = std::make_shared<DecodedStream>(std::move(stream), shouldLoop, lookaheadFrames);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            streams.push_back(decodedStream);
+            woken = true;
+        }
+
+        wake.notify_one();
+        return decodedStream;
+    }
+
+    void StreamDecoder::Wake()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            woken = true;
+        }
+
+        wake.notify_one();
+    }
+
+    uint64_t StreamDecoder::GetUnderrunCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        uint64_t underrunCount = droppedUnderrunCount;
+        for (const auto &decodedStream : streams)
+        {
+            underrunCount += decodedStream->GetUnderrunCount();
+        }
+
+        return underrunCount;
+    }
+
+    void StreamDecoder::Run()
+    {
+        std::vector<int16_t> scratch(DecodeChunkFrames * 8);
+        std::vector<std::shared_ptr<DecodedStream>> pass;
+
+        // a stream drains a quarter of its lookahead between passes
+        auto interval = std::chrono::duration<float>(std::max(lookahead / 4, 0.001f));
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping)
+        {
+            for (auto iterator = streams.begin(); iterator != streams.end();)
+            {
+                if ((*iterator)->IsCancelled())
+                {
+                    droppedUnderrunCount += (*iterator)->GetUnderrunCount();
+                    iterator = streams.erase(iterator);
+                }
+                else
+                {
+                    ++iterator;
+                }
+            }
+
+            // decode without the lock so a slow decode never holds up a Play on the game thread
+            pass = streams;
+            lock.unlock();
+
+            for (const auto &decodedStream : pass)
+            {
+                decodedStream->Decode(scratch);
+            }
+            pass.clear();
+
+            lock.lock();
+            wake.wait_for(lock, interval, [this] { return stopping || woken; });
+            woken = false;
+        }
+    }
+} // namespace Lucky
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -45,12 +47,63 @@ namespace Lucky
         "	gl_FragColor = texture2D(TextureSampler, v_texcoord) * v_color;\n"
         "}\n";
 
+    constexpr char multiTextureVertexShaderSource[] =
+        // input from CPU
+        "attribute vec4 position;\n"
+        "attribute vec4 color;\n"
+        "attribute vec2 texcoord;\n"
+        "attribute float textureindex;\n"
+        // output to fragment shader
+        "varying vec4 v_color;\n"
+        "varying vec2 v_texcoord;\n"
+        "varying float v_textureindex;\n"
+        // custom input from program
+        "uniform mat4 ProjectionMatrix;\n"
+        //
+        "void main()\n"
+        "{\n"
+        "	gl_Position = ProjectionMatrix * position;\n"
+        "	v_color = color;\n"
+        "	v_texcoord = texcoord;\n"
+        "	v_textureindex = textureindex;\n"
+        "}\n";
+
+    // sampler arrays can't be indexed with a varying in this GLSL version, so branch instead
+    constexpr char multiTextureFragmentShaderSource[] =
+        // input from vertex shader
+        "varying vec4 v_color;\n"
+        "varying vec2 v_texcoord;\n"
+        "varying float v_textureindex;\n"
+        // custom input from program
+        "uniform sampler2D TextureSampler;\n"
+        "uniform sampler2D TextureSampler1;\n"
+        "uniform sampler2D TextureSampler2;\n"
+        "uniform sampler2D TextureSampler3;\n"
+        //
+        "void main()\n"
+        "{\n"
+        "	vec4 texel;\n"
+        "	if (v_textureindex < 0.5)\n"
+        "		texel = texture2D(TextureSampler, v_texcoord);\n"
+        "	else if (v_textureindex < 1.5)\n"
+        "		texel = texture2D(TextureSampler1, v_texcoord);\n"
+        "	else if (v_textureindex < 2.5)\n"
+        "		texel = texture2D(TextureSampler2, v_texcoord);\n"
+        "	else\n"
+        "		texel = texture2D(TextureSampler3, v_texcoord);\n"
+        "	gl_FragColor = texel * v_color;\n"
+        "}\n";
+
+    static const char *textureSamplerNames[BatchRenderer::MaximumTextures] = {
+        "TextureSampler", "TextureSampler1", "TextureSampler2", "TextureSampler3"};
+
     BatchRenderer::BatchRenderer(std::shared_ptr<GraphicsDevice> graphicsDevice, uint32_t maximumTriangles)
         : graphicsDevice(graphicsDevice)
     {
         assert(maximumTriangles > 0);
 
         maximumVertices = maximumTriangles * 3;
+        textureCount = 0;
         batchStarted = false;
 
         defaultVertexShader = std::make_unique<VertexShader>(
@@ -59,6 +112,12 @@ namespace Lucky
             (uint8_t *)defaultFragmentShaderSource, (int)strlen(defaultFragmentShaderSource));
         defaultShaderProgram =
             std::make_shared<ShaderProgram>(graphicsDevice, *defaultVertexShader, *defaultFragmentShader);
+        multiTextureVertexShader = std::make_unique<VertexShader>(
+            (uint8_t *)multiTextureVertexShaderSource, (int)strlen(multiTextureVertexShaderSource));
+        multiTextureFragmentShader = std::make_unique<FragmentShader>(
+            (uint8_t *)multiTextureFragmentShaderSource, (int)strlen(multiTextureFragmentShaderSource));
+        multiTextureShaderProgram =
+            std::make_shared<ShaderProgram>(graphicsDevice, *multiTextureVertexShader, *multiTextureFragmentShader);
         vertexBuffer = std::make_unique<VertexBuffer>(VertexBufferType::Dynamic, maximumVertices);
 
         vertices.resize(maximumVertices);
@@ -66,6 +125,10 @@ namespace Lucky
 
     BatchRenderer::~BatchRenderer()
     {
+        if (batchStarted)
+        {
+            ReleaseTextures();
+        }
     }
 
     void BatchRenderer::Begin(BlendMode blendMode, std::shared_ptr<Texture> texture,
@@ -80,9 +143,47 @@ namespace Lucky
         activeVertices = 0;
         batchStarted = true;
         this->blendMode = blendMode;
-        this->texture = texture;
+        this->textures[0] = texture;
+        this->textureCount = 1;
         this->currentShaderProgram = (shaderProgram != nullptr) ? shaderProgram : defaultShaderProgram;
         this->transformMatrix = transformMatrix;
+
+        HoldTextures();
+    }
+
+    void BatchRenderer::Begin(BlendMode blendMode, const std::vector<std::shared_ptr<Texture>> &textures,
+        std::shared_ptr<ShaderProgram> shaderProgram, const glm::mat4 &transformMatrix)
+    {
+        assert(!textures.empty() && textures.size() <= MaximumTextures);
+
+        if (batchStarted)
+        {
+            // todo:
+            throw;
+        }
+
+        activeVertices = 0;
+        batchStarted = true;
+        this->blendMode = blendMode;
+        this->textureCount = (uint32_t)textures.size();
+        for (uint32_t i = 0; i < textureCount; i++)
+        {
+            this->textures[i] = textures[i];
+        }
+
+        // a single texture doesn't need the branching shader
+        if (shaderProgram != nullptr)
+        {
+            this->currentShaderProgram = shaderProgram;
+        }
+        else
+        {
+            this->currentShaderProgram = (textureCount > 1) ? multiTextureShaderProgram : defaultShaderProgram;
+        }
+
+        this->transformMatrix = transformMatrix;
+
+        HoldTextures();
     }
 
     void BatchRenderer::End()
@@ -94,16 +195,22 @@ namespace Lucky
         }
 
         Flush();
+        ReleaseTextures();
 
         currentShaderProgram.reset();
-        texture.reset();
+        for (uint32_t i = 0; i < textureCount; i++)
+        {
+            textures[i].reset();
+        }
+        textureCount = 0;
         batchStarted = false;
     }
 
-    void BatchRenderer::BatchQuadUV(
-        const glm::vec2 &uv0, const glm::vec2 &uv1, const glm::vec2 &xy0, const glm::vec2 &xy1, const Color &color)
+    void BatchRenderer::BatchQuadUV(const glm::vec2 &uv0, const glm::vec2 &uv1, const glm::vec2 &xy0,
+        const glm::vec2 &xy1, const Color &color, uint32_t textureIndex)
     {
         // todo: check batchStarted
+        assert(textureIndex < textureCount);
 
         if (activeVertices + 6 > maximumVertices)
         {
@@ -129,6 +236,7 @@ namespace Lucky
         vertices->g = color.g;
         vertices->b = color.b;
         vertices->a = color.a;
+        vertices->textureIndex = (float)textureIndex;
         vertices++;
 
         vertices->x = xy1.x;
@@ -139,6 +247,7 @@ namespace Lucky
         vertices->g = color.g;
         vertices->b = color.b;
         vertices->a = color.a;
+        vertices->textureIndex = (float)textureIndex;
         vertices++;
 
         vertices->x = xy1.x;
@@ -149,6 +258,7 @@ namespace Lucky
         vertices->g = color.g;
         vertices->b = color.b;
         vertices->a = color.a;
+        vertices->textureIndex = (float)textureIndex;
         vertices++;
 
         *vertices = *(vertices - 3);
@@ -164,15 +274,18 @@ namespace Lucky
         vertices->g = color.g;
         vertices->b = color.b;
         vertices->a = color.a;
+        vertices->textureIndex = (float)textureIndex;
 
         activeVertices += 6;
     }
 
     void BatchRenderer::BatchQuad(Rectangle *sourceRectangle, const glm::vec2 &position, const float rotation,
-        const glm::vec2 &scale, const glm::vec2 &origin, const UVMode uvMode, const Color &color)
+        const glm::vec2 &scale, const glm::vec2 &origin, const UVMode uvMode, const Color &color,
+        uint32_t textureIndex)
     {
         // todo: check batchStarted
         // todo: check for null texture
+        assert(textureIndex < textureCount);
 
         if (activeVertices + 6 > maximumVertices)
         {
@@ -183,6 +296,7 @@ namespace Lucky
         float destY = position.y;
         float destW = scale.x;
         float destH = scale.y;
+        const std::shared_ptr<Texture> &texture = textures[textureIndex];
         int textureW = texture->GetWidth();
         int textureH = texture->GetHeight();
         Rectangle source;
@@ -257,6 +371,7 @@ namespace Lucky
         vertices->g = color.g;
         vertices->b = color.b;
         vertices->a = color.a;
+        vertices->textureIndex = (float)textureIndex;
         vertices++;
 
         cornerX = (1.0f - origin.x) * destW;
@@ -269,6 +384,7 @@ namespace Lucky
         vertices->g = color.g;
         vertices->b = color.b;
         vertices->a = color.a;
+        vertices->textureIndex = (float)textureIndex;
         vertices++;
 
         cornerX = (1.0f - origin.x) * destW;
@@ -281,6 +397,7 @@ namespace Lucky
         vertices->g = color.g;
         vertices->b = color.b;
         vertices->a = color.a;
+        vertices->textureIndex = (float)textureIndex;
         vertices++;
 
         *vertices = *(vertices - 3);
@@ -298,6 +415,7 @@ namespace Lucky
         vertices->g = color.g;
         vertices->b = color.b;
         vertices->a = color.a;
+        vertices->textureIndex = (float)textureIndex;
 
         activeVertices += 6;
     }
@@ -326,11 +444,51 @@ namespace Lucky
         }
     }
 
+    void BatchRenderer::BatchVertices(
+        const Vertex *triangleVertices, uint32_t vertexCount, const glm::vec2 &offset, const Color &color)
+    {
+        assert(triangleVertices != nullptr);
+        assert(vertexCount % 3 == 0);
+
+        // todo: check batchStarted
+
+        while (vertexCount > 0)
+        {
+            if (activeVertices + 3 > maximumVertices)
+            {
+                Flush();
+            }
+
+            // as many whole triangles as fit before the next flush
+            uint32_t count = std::min(vertexCount, (maximumVertices - activeVertices) / 3 * 3);
+
+            Vertex *vertex = &vertices[activeVertices];
+            for (uint32_t i = 0; i < count; i++)
+            {
+                *vertex = *triangleVertices++;
+                vertex->x += offset.x;
+                vertex->y += offset.y;
+                vertex->r *= color.r;
+                vertex->g *= color.g;
+                vertex->b *= color.b;
+                vertex->a *= color.a;
+                vertex++;
+            }
+
+            activeVertices += count;
+            vertexCount -= count;
+        }
+    }
+
     void BatchRenderer::Flush()
     {
-        assert(activeVertices > 0);
         assert(activeVertices % 3 == 0);
 
+        if (activeVertices == 0)
+        {
+            return;
+        }
+
         Rectangle viewport;
         graphicsDevice->GetViewport(viewport);
 
@@ -351,10 +509,18 @@ namespace Lucky
         graphicsDevice->SetBlendMode(blendMode);
         graphicsDevice->ApplyShaderProgram(*currentShaderProgram);
 
-        auto textureSamplerLocation = currentShaderProgram->GetParameterLocation("TextureSampler");
-        if (textureSamplerLocation != -1 && texture)
+        for (uint32_t i = 0; i < textureCount; i++)
         {
-            currentShaderProgram->SetParameter("TextureSampler", *texture, 0);
+            auto textureSamplerLocation = currentShaderProgram->GetParameterLocation(textureSamplerNames[i]);
+            if (textureSamplerLocation != -1 && textures[i])
+            {
+                if (textures[i]->HasPendingUpdates())
+                {
+                    textures[i]->FlushTextureUpdates();
+                }
+
+                currentShaderProgram->SetParameter(textureSamplerNames[i], *textures[i], i);
+            }
         }
 
         auto projectionMatrixLocation = currentShaderProgram->GetParameterLocation("ProjectionMatrix");
@@ -369,5 +535,31 @@ namespace Lucky
         graphicsDevice->DrawPrimitives(*vertexBuffer, PrimitiveType::Triangles, 0, activeVertices / 3);
 
         activeVertices = 0;
+
+        // the batch stays open, but nothing batched so far is waiting to be drawn any more
+        ReleaseTextures();
+        HoldTextures();
+    }
+
+    void BatchRenderer::HoldTextures()
+    {
+        for (uint32_t i = 0; i < textureCount; i++)
+        {
+            if (textures[i])
+            {
+                textures[i]->HoldForBatch();
+            }
+        }
+    }
+
+    void BatchRenderer::ReleaseTextures()
+    {
+        for (uint32_t i = 0; i < textureCount; i++)
+        {
+            if (textures[i])
+            {
+                textures[i]->ReleaseFromBatch();
+            }
+        }
     }
 } // namespace Lucky
@@ -1,11 +1,140 @@
+#include <assert.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <future>
+#include <thread>
+
 #include <spdlog/spdlog.h>
 
 #include <Lucky/Graphics/Font.hpp>
+#include <Lucky/Utility/Utf8.hpp>
 
 namespace Lucky
 {
+    static const uint64_t emptyKerningPair = UINT64_MAX;
+
+    static inline uint64_t KerningKey(uint32_t first, uint32_t second)
+    {
+        return ((uint64_t)first << 32) | second;
+    }
+
+    static inline uint32_t HashKerningKey(uint64_t key)
+    {
+        return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+    }
+
+    static void AddQuadVertices(std::vector<Vertex> &vertices, float x0, float y0, float x1, float y1, float u0,
+        float v0, float u1, float v1, uint32_t page)
+    {
+        // same corners and order as BatchRenderer::BatchQuadUV, white so the draw color tints it
+        Vertex topLeft = {x0, y0, u0, v0, 1.0f, 1.0f, 1.0f, 1.0f, (float)page};
+        Vertex topRight = {x1, y0, u1, v0, 1.0f, 1.0f, 1.0f, 1.0f, (float)page};
+        Vertex bottomRight = {x1, y1, u1, v1, 1.0f, 1.0f, 1.0f, 1.0f, (float)page};
+        Vertex bottomLeft = {x0, y1, u0, v1, 1.0f, 1.0f, 1.0f, 1.0f, (float)page};
+
+        vertices.push_back(topLeft);
+        vertices.push_back(topRight);
+        vertices.push_back(bottomRight);
+        vertices.push_back(topLeft);
+        vertices.push_back(bottomRight);
+        vertices.push_back(bottomLeft);
+    }
+
+    static void AddShelf(std::vector<uint32_t> &shelves, uint32_t shelf)
+    {
+        // a layout only spans a few shelves, so a search beats keeping them sorted
+        if (std::find(shelves.begin(), shelves.end(), shelf) == shelves.end())
+        {
+            shelves.push_back(shelf);
+        }
+    }
+
+    void Font::FontEntry::AddGlyph(int codePoint, uint32_t glyph)
+    {
+        if (codePoint >= 0 && codePoint < directGlyphCount)
+        {
+            directGlyphs[codePoint] = glyph;
+        }
+        else
+        {
+            sparseGlyphs[codePoint] = glyph;
+        }
+    }
+
+    uint32_t Font::FontEntry::FindGlyph(int codePoint) const
+    {
+        if (codePoint >= 0 && codePoint < directGlyphCount)
+        {
+            return directGlyphs[codePoint];
+        }
+
+        auto found = sparseGlyphs.find(codePoint);
+        return found != sparseGlyphs.end() ? found->second : invalidGlyph;
+    }
+
+    void Font::FontEntry::AddKerning(uint32_t first, uint32_t second, int advance)
+    {
+        if ((kerningCount + 1) * 2 > kerning.size())
+        {
+            std::vector<KerningPair> previous(kerning.size() < 64 ? 64 : kerning.size() * 2,
+                KerningPair{emptyKerningPair, 0});
+            previous.swap(kerning);
+            kerningCount = 0;
+
+            for (const KerningPair &pair : previous)
+            {
+                if (pair.glyphs != emptyKerningPair)
+                {
+                    AddKerning((uint32_t)(pair.glyphs >> 32), (uint32_t)pair.glyphs, pair.advance);
+                }
+            }
+        }
+
+        uint64_t key = KerningKey(first, second);
+        uint32_t mask = (uint32_t)kerning.size() - 1;
+
+        for (uint32_t slot = HashKerningKey(key) & mask;; slot = (slot + 1) & mask)
+        {
+            if (kerning[slot].glyphs == key)
+            {
+                kerning[slot].advance = advance;
+                return;
+            }
+
+            if (kerning[slot].glyphs == emptyKerningPair)
+            {
+                kerning[slot] = {key, advance};
+                kerningCount++;
+                return;
+            }
+        }
+    }
+
+    int Font::FontEntry::GetKerning(uint32_t first, uint32_t second) const
+    {
+        if (kerningCount == 0)
+        {
+            return 0;
+        }
+
+        uint64_t key = KerningKey(first, second);
+        uint32_t mask = (uint32_t)kerning.size() - 1;
+
+        for (uint32_t slot = HashKerningKey(key) & mask;; slot = (slot + 1) & mask)
+        {
+            if (kerning[slot].glyphs == key)
+            {
+                return kerning[slot].advance;
+            }
+
+            if (kerning[slot].glyphs == emptyKerningPair)
+            {
+                return 0;
+            }
+        }
+    }
+
     Font::Font(const std::string &fileName)
     {
         FILE *fontFile = fopen(fileName.c_str(), "rb");
@@ -55,50 +184,138 @@ namespace Lucky
     std::shared_ptr<Texture> Font::CreateFontEntry(const std::string &name, const float fontSize, int *codePoints,
         int pointCount, uint32_t oversampling, bool kerningEnabled)
     {
-        FontEntry entry;
-        entry.codePoints.insert(entry.codePoints.end(), codePoints, codePoints + pointCount);
-        entry.packedData.resize(pointCount);
+        FontEntryRequest request;
+        request.font = this;
+        request.entryName = name;
+        request.fontSize = fontSize;
+        request.codePoints = codePoints;
+        request.pointCount = pointCount;
+        request.oversampling = oversampling;
+        request.kerningEnabled = kerningEnabled;
 
-        stbtt_pack_range range;
-        range.font_size = fontSize;
-        range.array_of_unicode_codepoints = codePoints;
-        range.num_chars = pointCount;
-        range.chardata_for_range = &entry.packedData[0];
+        return CreateSharedFontEntries({request});
+    }
+
+    std::shared_ptr<Texture> Font::CreateSharedFontEntries(const std::vector<FontEntryRequest> &requests)
+    {
+        assert(!requests.empty());
+
+        std::vector<FontEntry> entries(requests.size());
+        std::vector<stbtt_pack_range> ranges(requests.size());
+        std::vector<int> firstRects(requests.size());
+        int totalPointCount = 0;
+
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            const FontEntryRequest &request = requests[i];
+            assert(request.font != nullptr);
+
+            FontEntry &entry = entries[i];
+            entry.size = request.fontSize;
+            entry.codePoints.insert(
+                entry.codePoints.end(), request.codePoints, request.codePoints + request.pointCount);
+            entry.packedData.resize(request.pointCount);
+
+            entry.directGlyphs.assign(FontEntry::directGlyphCount, FontEntry::invalidGlyph);
+            for (int j = 0; j < request.pointCount; j++)
+            {
+                entry.AddGlyph(request.codePoints[j], (uint32_t)j);
+            }
+
+            stbtt_pack_range &range = ranges[i];
+            range = {};
+            range.font_size = request.fontSize;
+            range.array_of_unicode_codepoints = request.codePoints;
+            range.num_chars = request.pointCount;
+            range.chardata_for_range = &entry.packedData[0];
+
+            firstRects[i] = totalPointCount;
+            totalPointCount += request.pointCount;
+        }
 
         stbtt_pack_context packContext;
 
-        bool done = false;
         bool horizVert = true;
         int sizeIncrement = 512;
         int bitmapWidth = 512;
         int bitmapHeight = 512;
 
-        std::vector<uint8_t> bitmapData(bitmapWidth * bitmapHeight, 0);
+        // glyph boxes only depend on the oversampling and padding, so gather them once and
+        // only redo the packing when the bitmap has to grow. Each range remembers the
+        // oversampling it was gathered with, so requests can use different amounts.
+        std::vector<stbrp_rect> rects(totalPointCount);
+        int rectCount = 0;
+        stbtt_PackBegin(&packContext, nullptr, bitmapWidth, bitmapHeight, 0, 1, nullptr);
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            const FontEntryRequest &request = requests[i];
+            stbtt_PackSetOversampling(&packContext, request.oversampling, request.oversampling);
+            rectCount += stbtt_PackFontRangesGatherRects(
+                &packContext, &request.font->fontInfo, &ranges[i], 1, &rects[firstRects[i]]);
+        }
+        stbtt_PackEnd(&packContext);
 
-        do
+        while (true)
         {
-            stbtt_PackBegin(&packContext, &bitmapData[0], bitmapWidth, bitmapHeight, 0, 1, nullptr);
-            stbtt_PackSetOversampling(&packContext, oversampling, oversampling);
-            if (!stbtt_PackFontRanges(&packContext, (const uint8_t *)fontMemoryBuffer, 0, &range, 1))
+            stbtt_PackBegin(&packContext, nullptr, bitmapWidth, bitmapHeight, 0, 1, nullptr);
+            stbtt_PackFontRangesPackRects(&packContext, &rects[0], rectCount);
+
+            bool allPacked = std::all_of(
+                rects.begin(), rects.begin() + rectCount, [](const stbrp_rect &rect) { return rect.was_packed != 0; });
+            if (allPacked)
             {
-                if (horizVert)
-                {
-                    bitmapWidth += sizeIncrement;
-                }
-                else
-                {
-                    bitmapHeight += sizeIncrement;
-                }
-                horizVert = !horizVert;
-                bitmapData.resize(bitmapWidth * bitmapHeight);
-                stbtt_PackEnd(&packContext);
+                break;
+            }
+
+            stbtt_PackEnd(&packContext);
+
+            if (horizVert)
+            {
+                bitmapWidth += sizeIncrement;
             }
             else
             {
-                stbtt_PackEnd(&packContext);
-                done = true;
+                bitmapHeight += sizeIncrement;
             }
-        } while (!done);
+            horizVert = !horizVert;
+        }
+
+        std::vector<uint8_t> bitmapData(bitmapWidth * bitmapHeight, 0);
+        packContext.pixels = &bitmapData[0];
+
+        // Every glyph renders into its own rectangle, so the rasterization can be split across
+        // threads. Each thread needs its own copy of the context because stb_truetype changes the
+        // oversampling fields on it while rendering.
+        int threadCount = std::max<int>(1, std::min<int>(std::thread::hardware_concurrency(), rectCount / 64));
+        int glyphsPerThread = (rectCount + threadCount - 1) / threadCount;
+
+        std::vector<std::future<void>> rasterizers;
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            const FontEntryRequest &request = requests[i];
+
+            // chunks never cross requests, every request can come from a different font
+            for (int first = 0; first < request.pointCount; first += glyphsPerThread)
+            {
+                rasterizers.push_back(std::async(std::launch::async, [&, i, first]() {
+                    stbtt_pack_context threadContext = packContext;
+                    stbtt_pack_range threadRange = ranges[i];
+                    threadRange.array_of_unicode_codepoints = request.codePoints + first;
+                    threadRange.num_chars = std::min(glyphsPerThread, request.pointCount - first);
+                    threadRange.chardata_for_range = &entries[i].packedData[first];
+
+                    stbtt_PackFontRangesRenderIntoRects(
+                        &threadContext, &request.font->fontInfo, &threadRange, 1, &rects[firstRects[i] + first]);
+                }));
+            }
+        }
+
+        for (auto &rasterizer : rasterizers)
+        {
+            rasterizer.get();
+        }
+
+        stbtt_PackEnd(&packContext);
 
         std::vector<uint8_t> colorBitmapData(bitmapData.size() * 4, 0);
         uint8_t *s = &bitmapData[0];
@@ -113,29 +330,192 @@ namespace Lucky
             s++;
         }
 
-        entry.texture = std::make_shared<Lucky::Texture>(Lucky::TextureType::Default, bitmapWidth, bitmapHeight,
+        auto texture = std::make_shared<Lucky::Texture>(Lucky::TextureType::Default, bitmapWidth, bitmapHeight,
             &colorBitmapData[0], (uint32_t)colorBitmapData.size(), Lucky::TextureFilter::Linear);
 
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            const FontEntryRequest &request = requests[i];
+            Font &font = *request.font;
+
+            FontEntry &entry = entries[i];
+            entry.texture = texture;
+            entry.inverseTextureWidth = 1.0f / bitmapWidth;
+            entry.inverseTextureHeight = 1.0f / bitmapHeight;
+            entry.generation = ++font.entryGeneration;
+            entry.scaleFactor = stbtt_ScaleForPixelHeight(&font.fontInfo, request.fontSize);
+
+            if (request.kerningEnabled)
+            {
+                font.BuildKerning(entry);
+            }
+
+            font.fontEntries[request.entryName] = std::move(entry);
+        }
+
+        return texture;
+    }
+
+    std::shared_ptr<Texture> Font::CreateDynamicFontEntry(
+        const std::string &name, const float fontSize, uint32_t pageSize, uint32_t pageCount, bool kerningEnabled)
+    {
+        FontEntry entry;
+        entry.size = fontSize;
         entry.scaleFactor = stbtt_ScaleForPixelHeight(&fontInfo, fontSize);
+        entry.glyphCache = std::make_shared<GlyphCache>(fontInfo, fontSize, pageSize, pageCount);
+        entry.texture = entry.glyphCache->GetTextures()[0];
+        entry.kerningEnabled = kerningEnabled;
+        entry.generation = ++entryGeneration;
 
-        if (kerningEnabled)
+        // the glyphs aren't known yet, so keep every pair from the kern table
+        int tableLength = kerningEnabled ? stbtt_GetKerningTableLength(&fontInfo) : 0;
+        if (tableLength > 0)
         {
-            for (int first = 0; first < pointCount; first++)
+            std::vector<stbtt_kerningentry> table(tableLength);
+            tableLength = stbtt_GetKerningTable(&fontInfo, &table[0], tableLength);
+
+            for (int i = 0; i < tableLength; i++)
             {
-                for (int second = 0; second < pointCount; second++)
+                if (table[i].advance != 0)
                 {
-                    int kern = stbtt_GetCodepointKernAdvance(&fontInfo, codePoints[first], codePoints[second]);
-                    if (kern != 0)
-                    {
-                        entry.kerning[std::pair<int, int>(codePoints[first], codePoints[second])] = kern;
-                    }
+                    entry.AddKerning(table[i].glyph1, table[i].glyph2, table[i].advance);
                 }
             }
         }
 
-        fontEntries[name] = entry;
+        fontEntries[name] = std::move(entry);
 
-        return entry.texture;
+        return fontEntries[name].texture;
+    }
+
+    std::shared_ptr<Texture> Font::CreateSdfFontEntry(const std::string &name, const float fontSize, int *codePoints,
+        int pointCount, int padding, bool kerningEnabled)
+    {
+        assert(padding > 0);
+
+        FontEntry entry;
+        entry.size = fontSize;
+        entry.distanceField = true;
+        entry.scaleFactor = stbtt_ScaleForPixelHeight(&fontInfo, fontSize);
+        entry.codePoints.insert(entry.codePoints.end(), codePoints, codePoints + pointCount);
+        entry.packedData.resize(pointCount);
+
+        entry.directGlyphs.assign(FontEntry::directGlyphCount, FontEntry::invalidGlyph);
+        for (int i = 0; i < pointCount; i++)
+        {
+            entry.AddGlyph(codePoints[i], (uint32_t)i);
+        }
+
+        // 128 on the outline, falling to 0 at padding pixels outside it
+        const uint8_t onEdgeValue = 128;
+        const float pixelDistanceScale = (float)onEdgeValue / padding;
+
+        std::vector<uint8_t *> distanceFields(pointCount);
+        std::vector<stbrp_rect> rects(pointCount);
+
+        for (int i = 0; i < pointCount; i++)
+        {
+            int width = 0, height = 0, xoff = 0, yoff = 0;
+            distanceFields[i] = stbtt_GetCodepointSDF(&fontInfo, entry.scaleFactor, codePoints[i], padding,
+                onEdgeValue, pixelDistanceScale, &width, &height, &xoff, &yoff);
+
+            int advanceWidth, leftSideBearing;
+            stbtt_GetCodepointHMetrics(&fontInfo, codePoints[i], &advanceWidth, &leftSideBearing);
+
+            stbtt_packedchar &cd = entry.packedData[i];
+            cd.xoff = (float)xoff;
+            cd.yoff = (float)yoff;
+            cd.xoff2 = (float)(xoff + width);
+            cd.yoff2 = (float)(yoff + height);
+            cd.xadvance = advanceWidth * entry.scaleFactor;
+
+            // one pixel gap so neighbouring fields don't bleed into each other when filtered
+            rects[i].id = i;
+            rects[i].w = width > 0 ? width + 1 : 0;
+            rects[i].h = height > 0 ? height + 1 : 0;
+        }
+
+        bool horizVert = true;
+        int sizeIncrement = 512;
+        int bitmapWidth = 512;
+        int bitmapHeight = 512;
+
+        std::vector<stbrp_node> nodes;
+        stbrp_context packContext;
+
+        while (true)
+        {
+            nodes.resize(bitmapWidth);
+            stbrp_init_target(&packContext, bitmapWidth, bitmapHeight, &nodes[0], bitmapWidth);
+            if (stbrp_pack_rects(&packContext, &rects[0], pointCount))
+            {
+                break;
+            }
+
+            if (horizVert)
+            {
+                bitmapWidth += sizeIncrement;
+            }
+            else
+            {
+                bitmapHeight += sizeIncrement;
+            }
+            horizVert = !horizVert;
+        }
+
+        // premultiplied white with the distance as alpha like CreateFontEntry's coverage, so it can
+        // also be drawn with the default shader
+        std::vector<uint8_t> colorBitmapData(bitmapWidth * bitmapHeight * 4, 0);
+
+        for (int i = 0; i < pointCount; i++)
+        {
+            stbtt_packedchar &cd = entry.packedData[i];
+            const stbrp_rect &rect = rects[i];
+            int width = (int)(cd.xoff2 - cd.xoff);
+            int height = (int)(cd.yoff2 - cd.yoff);
+
+            cd.x0 = (unsigned short)rect.x;
+            cd.y0 = (unsigned short)rect.y;
+            cd.x1 = (unsigned short)(rect.x + width);
+            cd.y1 = (unsigned short)(rect.y + height);
+
+            if (distanceFields[i] == nullptr)
+            {
+                continue;
+            }
+
+            for (int row = 0; row < height; row++)
+            {
+                const uint8_t *s = distanceFields[i] + row * width;
+                uint8_t *d = &colorBitmapData[((rect.y + row) * bitmapWidth + rect.x) * 4];
+
+                for (int column = 0; column < width; column++)
+                {
+                    *d++ = *s;
+                    *d++ = *s;
+                    *d++ = *s;
+                    *d++ = *s;
+                    s++;
+                }
+            }
+
+            stbtt_FreeSDF(distanceFields[i], nullptr);
+        }
+
+        entry.texture = std::make_shared<Lucky::Texture>(Lucky::TextureType::Default, bitmapWidth, bitmapHeight,
+            &colorBitmapData[0], (uint32_t)colorBitmapData.size(), Lucky::TextureFilter::Linear);
+        entry.inverseTextureWidth = 1.0f / bitmapWidth;
+        entry.inverseTextureHeight = 1.0f / bitmapHeight;
+        entry.generation = ++entryGeneration;
+
+        if (kerningEnabled)
+        {
+            BuildKerning(entry);
+        }
+
+        fontEntries[name] = std::move(entry);
+
+        return fontEntries[name].texture;
     }
 
     std::shared_ptr<Texture> Font::GetTexture(const std::string &entryName)
@@ -144,49 +524,610 @@ namespace Lucky
         return entry.texture;
     }
 
+    std::vector<std::shared_ptr<Texture>> Font::GetTextures(const std::string &entryName)
+    {
+        auto &entry = fontEntries[entryName];
+        if (entry.glyphCache)
+        {
+            return entry.glyphCache->GetTextures();
+        }
+
+        return {entry.texture};
+    }
+
+    template <typename Visitor>
+    float Font::WalkGlyphs(FontEntry &entry, const int *codePoints, size_t count, float x, float scale, Visitor visit,
+        BatchRenderer *batchRenderer)
+    {
+        float xpos = x;
+        uint32_t previousGlyph = FontEntry::invalidGlyph;
+        GlyphQuad quad;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!FindGlyphQuad(entry, codePoints[i], quad, batchRenderer))
+            {
+                previousGlyph = FontEntry::invalidGlyph;
+                continue;
+            }
+
+            if (previousGlyph != FontEntry::invalidGlyph)
+            {
+                xpos += GetKerningAdvance(entry, previousGlyph, quad.glyph) * scale;
+            }
+            previousGlyph = quad.glyph;
+
+            visit(i, quad, xpos);
+
+            xpos += quad.advance * scale;
+        }
+
+        return xpos;
+    }
+
     void Font::DrawString(BatchRenderer &batchRenderer, const std::string &text, const std::string &entryName,
         const float x, const float y, Color color)
     {
         auto &entry = fontEntries[entryName];
+        DrawStringEntry(batchRenderer, entry, text, x, y, color, 1.0f);
+    }
 
-        float xpos = x;
-        int ch = 0;
+    void Font::DrawString(BatchRenderer &batchRenderer, const std::string &text, const std::string &entryName,
+        const float x, const float y, Color color, const float fontSize)
+    {
+        auto &entry = fontEntries[entryName];
+        DrawStringEntry(batchRenderer, entry, text, x, y, color, fontSize / entry.size);
+    }
 
-        while (text[ch])
+    TextBounds Font::MeasureString(const std::string &text, const std::string &entryName, const float fontSize)
+    {
+        auto &entry = fontEntries[entryName];
+        float scale = fontSize > 0.0f ? fontSize / entry.size : 1.0f;
+
+        if (entry.glyphCache)
+        {
+            entry.glyphCache->BeginUse();
+        }
+
+        codePointScratch.clear();
+        DecodeUtf8(text, codePointScratch);
+
+        TextBounds bounds;
+        bounds.top = -ascent * entry.scaleFactor * scale;
+        bounds.height = (ascent - descent) * entry.scaleFactor * scale;
+
+        if (!codePointScratch.empty())
+        {
+            bounds.width = WalkGlyphs(entry, &codePointScratch[0], codePointScratch.size(), 0.0f, scale,
+                [](size_t, const GlyphQuad &, float) {});
+        }
+
+        return bounds;
+    }
+
+    TextBounds Font::LayoutString(const std::string &text, const std::string &entryName, const float x,
+        const float y, std::vector<GlyphPosition> &glyphs, const float fontSize)
+    {
+        auto &entry = fontEntries[entryName];
+        float scale = fontSize > 0.0f ? fontSize / entry.size : 1.0f;
+
+        if (entry.glyphCache)
+        {
+            entry.glyphCache->BeginUse();
+        }
+
+        codePointScratch.clear();
+        DecodeUtf8(text, codePointScratch);
+
+        glyphs.clear();
+
+        TextBounds bounds;
+        bounds.left = x;
+        bounds.top = y - ascent * entry.scaleFactor * scale;
+        bounds.height = (ascent - descent) * entry.scaleFactor * scale;
+
+        if (codePointScratch.empty())
+        {
+            return bounds;
+        }
+
+        float end = WalkGlyphs(entry, &codePointScratch[0], codePointScratch.size(), x, scale,
+            [&](size_t index, const GlyphQuad &quad, float xpos) {
+                GlyphPosition glyph;
+                glyph.index = (uint32_t)index;
+                glyph.codePoint = codePointScratch[index];
+                glyph.x = xpos;
+                glyph.y = y;
+                glyph.advance = quad.advance * scale;
+
+                if (quad.visible)
+                {
+                    glyph.left = xpos + quad.x0 * scale;
+                    glyph.top = y + quad.y0 * scale;
+                    glyph.right = xpos + quad.x1 * scale;
+                    glyph.bottom = y + quad.y1 * scale;
+                }
+                else
+                {
+                    glyph.left = glyph.right = xpos;
+                    glyph.top = glyph.bottom = y;
+                }
+
+                glyphs.push_back(glyph);
+            });
+
+        bounds.width = end - x;
+        return bounds;
+    }
+
+    static float AlignLine(const TextLayoutOptions &options, float width)
+    {
+        if (options.alignment == TextAlignment::Center)
+        {
+            return options.maximumWidth > 0.0f ? (options.maximumWidth - width) * 0.5f : width * -0.5f;
+        }
+
+        if (options.alignment == TextAlignment::Right)
+        {
+            return options.maximumWidth > 0.0f ? options.maximumWidth - width : -width;
+        }
+
+        return 0.0f;
+    }
+
+    void Font::LayoutText(
+        TextLayout &layout, const std::string &text, const std::string &entryName, const TextLayoutOptions &options)
+    {
+        struct Line
+        {
+            size_t first;
+            size_t last;
+            float width;
+        };
+
+        auto &entry = fontEntries[entryName];
+        float scale = options.fontSize > 0.0f ? options.fontSize / entry.size : 1.0f;
+
+        if (entry.glyphCache)
+        {
+            entry.glyphCache->BeginUse();
+        }
+
+        uint32_t batchWaitCount = GetBatchWaitCount(entry);
+
+        std::vector<int> &codePoints = codePointScratch;
+        codePoints.clear();
+        DecodeUtf8(text, codePoints);
+
+        // measure first, alignment needs each line's width before its glyphs can be placed
+        std::vector<Line> lines;
+        size_t lineStart = 0;
+
+        while (true)
+        {
+            Line line;
+            line.first = lineStart;
+            lineStart = WrapLine(
+                entry, codePoints.data(), codePoints.size(), line.first, options.maximumWidth, scale, line.last, line.width);
+            lines.push_back(line);
+
+            // text ending in a line break still has an empty last line
+            bool lineBreak = line.last < codePoints.size() && codePoints[line.last] == '\n';
+            if (lineStart >= codePoints.size() && !lineBreak)
+            {
+                break;
+            }
+        }
+
+        float fontScale = entry.scaleFactor * scale;
+
+        layout.vertices.clear();
+        layout.shelves.clear();
+        layout.glyphCache = entry.glyphCache;
+        layout.lineHeight = (ascent - descent + lineGap) * fontScale * options.lineSpacing;
+        layout.lineCount = (uint32_t)lines.size();
+
+        float left = 0.0f;
+        float right = 0.0f;
+
+        for (size_t lineIndex = 0; lineIndex < lines.size(); lineIndex++)
+        {
+            const Line &line = lines[lineIndex];
+
+            float xpos = AlignLine(options, line.width);
+
+            left = lineIndex == 0 ? xpos : std::min(left, xpos);
+            right = lineIndex == 0 ? xpos + line.width : std::max(right, xpos + line.width);
+
+            float y = lineIndex * layout.lineHeight;
+
+            WalkGlyphs(entry, codePoints.data() + line.first, line.last - line.first, xpos, scale,
+                [&](size_t, const GlyphQuad &quad, float xpos) {
+                    if (quad.visible)
+                    {
+                        AddQuadVertices(layout.vertices, xpos + quad.x0 * scale, y + quad.y0 * scale,
+                            xpos + quad.x1 * scale, y + quad.y1 * scale, quad.u0, quad.v0, quad.u1, quad.v1,
+                            quad.page);
+
+                        if (entry.glyphCache)
+                        {
+                            AddShelf(layout.shelves, quad.shelf);
+                        }
+                    }
+                });
+        }
+
+        layout.bounds.left = left;
+        layout.bounds.width = right - left;
+        layout.bounds.top = -ascent * fontScale;
+        layout.bounds.height = (layout.lineCount - 1) * layout.lineHeight + (ascent - descent) * fontScale;
+
+        // glyphs skipped while a batch held their shelves fit once it's flushed, so a layout
+        // missing them is never current
+        layout.generation = GetBatchWaitCount(entry) == batchWaitCount ? GetLayoutGeneration(entry) : 0;
+    }
+
+    void Font::LayoutParagraph(
+        TextParagraph &paragraph, const std::string &entryName, const TextLayoutOptions &options)
+    {
+        auto &entry = fontEntries[entryName];
+        uint64_t generation = GetLayoutGeneration(entry);
+
+        bool fullLayout = paragraph.lines.empty() || paragraph.entryName != entryName ||
+                          !(paragraph.options == options) || paragraph.generation != generation;
+        if (!fullLayout && !paragraph.dirty)
+        {
+            paragraph.wrappedLineCount = 0;
+            return;
+        }
+
+        float scale = options.fontSize > 0.0f ? options.fontSize / entry.size : 1.0f;
+        float fontScale = entry.scaleFactor * scale;
+
+        if (entry.glyphCache)
+        {
+            entry.glyphCache->BeginUse();
+        }
+
+        uint32_t batchWaitCount = GetBatchWaitCount(entry);
+
+        const std::vector<int> &codePoints = paragraph.codePoints;
+        std::vector<TextParagraph::Line> &lines = paragraph.lines;
+
+        // A line only depends on where it starts and the text after it, so wrapping starts a line
+        // before the edit, in case its first word now fits on the previous line, and stops at the
+        // first line after the edit that starts where an old line does. The rest are kept as is.
+        size_t firstLine = 0;
+        uint32_t lineStart = 0;
+        if (!fullLayout)
+        {
+            // the line ending just before the edit counts as edited, its break may have been erased
+            firstLine = paragraph.FindLine(paragraph.dirtyStart > 0 ? paragraph.dirtyStart - 1 : 0);
+            firstLine = firstLine > 0 ? firstLine - 1 : 0;
+            lineStart = firstLine > 0 ? lines[firstLine].first : 0;
+        }
+
+        std::vector<TextParagraph::Line> wrapped;
+        size_t oldLine = firstLine;
+        size_t keptLine = lines.size();
+
+        while (true)
+        {
+            TextParagraph::Line line;
+            line.first = lineStart;
+
+            size_t last;
+            lineStart = (uint32_t)WrapLine(
+                entry, codePoints.data(), codePoints.size(), line.first, options.maximumWidth, scale, last, line.width);
+            line.last = (uint32_t)last;
+            line.next = lineStart;
+
+            float xpos = AlignLine(options, line.width);
+            line.carets.resize(line.last - line.first + 1);
+            uint32_t caret = 0;
+
+            float end = WalkGlyphs(entry, codePoints.data() + line.first, line.last - line.first, xpos, scale,
+                [&](size_t index, const GlyphQuad &quad, float xpos) {
+                    // code points without a glyph share the caret of the next one
+                    while (caret <= index)
+                    {
+                        line.carets[caret++] = xpos;
+                    }
+
+                    if (quad.visible)
+                    {
+                        AddQuadVertices(line.vertices, xpos + quad.x0 * scale, quad.y0 * scale,
+                            xpos + quad.x1 * scale, quad.y1 * scale, quad.u0, quad.v0, quad.u1, quad.v1, quad.page);
+
+                        if (entry.glyphCache)
+                        {
+                            AddShelf(line.shelves, quad.shelf);
+                        }
+                    }
+                });
+
+            while (caret < line.carets.size())
+            {
+                line.carets[caret++] = end;
+            }
+
+            wrapped.push_back(std::move(line));
+
+            bool lineBreak = last < codePoints.size() && codePoints[last] == '\n';
+            if (lineStart >= codePoints.size() && !lineBreak)
+            {
+                break;
+            }
+
+            if (!fullLayout && lineStart >= paragraph.dirtyEnd)
+            {
+                while (oldLine < lines.size() && lines[oldLine].first < lineStart)
+                {
+                    oldLine++;
+                }
+
+                if (oldLine < lines.size() && lines[oldLine].first == lineStart)
+                {
+                    keptLine = oldLine;
+                    break;
+                }
+            }
+        }
+
+        lines.erase(lines.begin() + firstLine, lines.begin() + keptLine);
+        lines.insert(lines.begin() + firstLine, std::make_move_iterator(wrapped.begin()),
+            std::make_move_iterator(wrapped.end()));
+
+        paragraph.entryName = entryName;
+        paragraph.options = options;
+        paragraph.glyphCache = entry.glyphCache;
+        paragraph.lineHeight = (ascent - descent + lineGap) * fontScale * options.lineSpacing;
+        paragraph.lineTop = -ascent * fontScale;
+        paragraph.lineBottom = -descent * fontScale;
+        paragraph.dirty = false;
+        paragraph.wrappedLineCount = (uint32_t)wrapped.size();
+
+        // glyphs the kept lines use may have been evicted to make room for new ones
+        if (!fullLayout && GetLayoutGeneration(entry) != generation)
+        {
+            lines.clear();
+            LayoutParagraph(paragraph, entryName, options);
+            return;
+        }
+
+        // like LayoutText, a paragraph missing glyphs because of a batch is laid out again
+        paragraph.generation = GetBatchWaitCount(entry) == batchWaitCount ? GetLayoutGeneration(entry) : 0;
+    }
+
+    bool Font::IsLayoutCurrent(const TextLayout &layout, const std::string &entryName) const
+    {
+        auto found = fontEntries.find(entryName);
+        return found != fontEntries.end() && layout.generation == GetLayoutGeneration(found->second);
+    }
+
+    bool Font::FindGlyphQuad(FontEntry &entry, int codePoint, GlyphQuad &quad, BatchRenderer *batchRenderer)
+    {
+        if (entry.glyphCache)
+        {
+            const CachedGlyph *glyph = entry.glyphCache->GetGlyph(codePoint);
+
+            // the only shelves left to evict hold glyphs of quads still in the batch, draw them first
+            if (glyph == nullptr && batchRenderer != nullptr && entry.glyphCache->IsWaitingForBatch())
+            {
+                batchRenderer->Flush();
+                glyph = entry.glyphCache->GetGlyph(codePoint);
+            }
+
+            if (glyph == nullptr)
+            {
+                return false;
+            }
+
+            quad = {glyph->u0, glyph->v0, glyph->u1, glyph->v1, glyph->xoff, glyph->yoff, glyph->xoff2, glyph->yoff2,
+                glyph->xadvance, (uint32_t)glyph->fontGlyph, glyph->page, glyph->shelf, !glyph->empty};
+            return true;
+        }
+
+        uint32_t glyph = entry.FindGlyph(codePoint);
+        if (glyph == FontEntry::invalidGlyph)
         {
-            int character = text[ch];
+            return false;
+        }
+
+        const stbtt_packedchar &cd = entry.packedData[glyph];
+        quad = {cd.x0 * entry.inverseTextureWidth, cd.y0 * entry.inverseTextureHeight,
+            cd.x1 * entry.inverseTextureWidth, cd.y1 * entry.inverseTextureHeight, cd.xoff, cd.yoff, cd.xoff2,
+            cd.yoff2, cd.xadvance, glyph, 0, 0, codePoint != ' '};
+        return true;
+    }
 
-            // find the character index
-            auto found = std::find_if(entry.codePoints.begin(), entry.codePoints.end(),
-                [character](const int cp) { return cp == character; });
+    size_t Font::WrapLine(FontEntry &entry, const int *codePoints, size_t count, size_t first, float maximumWidth,
+        float scale, size_t &last, float &width)
+    {
+        size_t breakIndex = std::string::npos;
+        float breakWidth = 0.0f;
+        float xpos = 0.0f;
+        uint32_t previousGlyph = FontEntry::invalidGlyph;
+        GlyphQuad quad;
 
-            if (found == entry.codePoints.end())
+        for (size_t i = first; i < count; i++)
+        {
+            int codePoint = codePoints[i];
+            if (codePoint == '\n')
             {
-                ++ch;
+                last = i;
+                width = xpos;
+                return i + 1;
+            }
+
+            if (!FindGlyphQuad(entry, codePoint, quad))
+            {
+                previousGlyph = FontEntry::invalidGlyph;
                 continue;
             }
 
-            const size_t index = found - entry.codePoints.begin();
-            auto cd = entry.packedData[index];
-            float iw = 1.0f / entry.texture->GetWidth();
-            float ih = 1.0f / entry.texture->GetHeight();
+            float advance = quad.advance * scale;
+            if (previousGlyph != FontEntry::invalidGlyph)
+            {
+                advance += GetKerningAdvance(entry, previousGlyph, quad.glyph) * scale;
+            }
 
-            if (text[ch] != ' ')
+            if (codePoint == ' ')
             {
-                batchRenderer.BatchQuadUV(glm::vec2(cd.x0 * iw, cd.y0 * ih), glm::vec2(cd.x1 * iw, cd.y1 * ih),
-                    glm::vec2(xpos + cd.xoff, y + cd.yoff), glm::vec2(xpos + cd.xoff2, y + cd.yoff2), color);
+                breakIndex = i;
+                breakWidth = xpos;
             }
+            else if (maximumWidth > 0.0f && xpos + advance > maximumWidth && i > first)
+            {
+                // wrap at the last space, or mid word if the word is wider than a line
+                if (breakIndex != std::string::npos)
+                {
+                    last = breakIndex;
+                    width = breakWidth;
+                    return breakIndex + 1;
+                }
+
+                last = i;
+                width = xpos;
+                return i;
+            }
+
+            xpos += advance;
+            previousGlyph = quad.glyph;
+        }
+
+        last = count;
+        width = xpos;
+        return count;
+    }
+
+    float Font::GetKerningAdvance(FontEntry &entry, uint32_t first, uint32_t second)
+    {
+        if (entry.kerningCount > 0)
+        {
+            return entry.scaleFactor * entry.GetKerning(first, second);
+        }
+
+        // fonts without a kern table are asked directly, stb_truetype can't list GPOS pairs up front
+        if (entry.glyphCache && entry.kerningEnabled)
+        {
+            return entry.scaleFactor * stbtt_GetGlyphKernAdvance(&fontInfo, (int)first, (int)second);
+        }
+
+        return 0.0f;
+    }
+
+    uint32_t Font::GetBatchWaitCount(const FontEntry &entry) const
+    {
+        return entry.glyphCache ? entry.glyphCache->GetBatchWaitCount() : 0;
+    }
+
+    uint64_t Font::GetLayoutGeneration(const FontEntry &entry) const
+    {
+        uint64_t evictionCount = entry.glyphCache ? entry.glyphCache->GetEvictionCount() : 0;
+        return ((uint64_t)entry.generation << 32) | evictionCount;
+    }
+
+    void Font::DrawStringEntry(BatchRenderer &batchRenderer, FontEntry &entry, const std::string &text, float x,
+        float y, Color color, float scale)
+    {
+        if (entry.glyphCache)
+        {
+            entry.glyphCache->BeginUse();
+        }
+
+        codePointScratch.clear();
+        DecodeUtf8(text, codePointScratch);
+        if (codePointScratch.empty())
+        {
+            return;
+        }
+
+        WalkGlyphs(entry, &codePointScratch[0], codePointScratch.size(), x, scale,
+            [&](size_t, const GlyphQuad &quad, float xpos) {
+                if (quad.visible)
+                {
+                    batchRenderer.BatchQuadUV(glm::vec2(quad.u0, quad.v0), glm::vec2(quad.u1, quad.v1),
+                        glm::vec2(xpos + quad.x0 * scale, y + quad.y0 * scale),
+                        glm::vec2(xpos + quad.x1 * scale, y + quad.y1 * scale), color, quad.page);
+
+                    // only once the quad is in, a flush to make room for it would release the shelf early
+                    if (entry.glyphCache)
+                    {
+                        entry.glyphCache->Touch(quad.shelf, true);
+                    }
+                }
+            },
+            &batchRenderer);
+    }
+
+    void Font::BuildKerning(FontEntry &entry)
+    {
+        // the font's glyph index for each of the entry's glyphs, sorted so pairs from the
+        // kerning table can be matched with a binary search
+        std::vector<std::pair<int, uint32_t>> fontGlyphs(entry.codePoints.size());
+        for (size_t i = 0; i < entry.codePoints.size(); i++)
+        {
+            fontGlyphs[i] = {stbtt_FindGlyphIndex(&fontInfo, entry.codePoints[i]), (uint32_t)i};
+        }
+
+        int tableLength = stbtt_GetKerningTableLength(&fontInfo);
+
+        if (tableLength > 0)
+        {
+            std::sort(fontGlyphs.begin(), fontGlyphs.end());
+
+            std::vector<stbtt_kerningentry> table(tableLength);
+            tableLength = stbtt_GetKerningTable(&fontInfo, &table[0], tableLength);
 
-            xpos += cd.xadvance;
-            if (text[ch + 1])
+            auto compareGlyph = [](const std::pair<int, uint32_t> &a, const std::pair<int, uint32_t> &b) {
+                return a.first < b.first;
+            };
+
+            for (int i = 0; i < tableLength; i++)
             {
-                auto kernFound = entry.kerning.find(std::pair<int, int>(text[ch], text[ch + 1]));
-                if (kernFound != entry.kerning.end())
+                const stbtt_kerningentry &pair = table[i];
+                if (pair.advance == 0)
+                {
+                    continue;
+                }
+
+                auto firstRange = std::equal_range(
+                    fontGlyphs.begin(), fontGlyphs.end(), std::pair<int, uint32_t>(pair.glyph1, 0), compareGlyph);
+                if (firstRange.first == firstRange.second)
                 {
-                    xpos += entry.scaleFactor * kernFound->second;
+                    continue;
+                }
+
+                auto secondRange = std::equal_range(
+                    fontGlyphs.begin(), fontGlyphs.end(), std::pair<int, uint32_t>(pair.glyph2, 0), compareGlyph);
+
+                // more than one code point can map to the same glyph
+                for (auto first = firstRange.first; first != firstRange.second; ++first)
+                {
+                    for (auto second = secondRange.first; second != secondRange.second; ++second)
+                    {
+                        entry.AddKerning(first->second, second->second, pair.advance);
+                    }
+                }
+            }
+        }
+        else
+        {
+            // stb_truetype can't enumerate GPOS pairs, so fonts that only kern through GPOS
+            // still have to be probed pair by pair. Using glyph indices at least skips the
+            // cmap lookups stbtt_GetCodepointKernAdvance does on every call.
+            for (const auto &first : fontGlyphs)
+            {
+                for (const auto &second : fontGlyphs)
+                {
+                    int kern = stbtt_GetGlyphKernAdvance(&fontInfo, first.first, second.first);
+                    if (kern != 0)
+                    {
+                        entry.AddKerning(first.second, second.second, kern);
+                    }
                 }
             }
-            ++ch;
         }
     }
 
@@ -197,5 +1138,7 @@ namespace Lucky
             spdlog::error("Couldn't initialize font.");
             throw;
         }
+
+        stbtt_GetFontVMetrics(&fontInfo, &ascent, &descent, &lineGap);
     }
 } // namespace Lucky
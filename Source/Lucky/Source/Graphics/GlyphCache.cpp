@@ -0,0 +1,262 @@
+#include <assert.h>
+#include <string.h>
+
+#include <spdlog/spdlog.h>
+
+#include <Lucky/Graphics/GlyphCache.hpp>
+
+namespace Lucky
+{
+    // shelf heights are rounded up to this so glyphs of similar sizes share shelves
+    static const uint32_t shelfHeightStep = 8;
+
+    // empty border around each glyph so linear filtering doesn't pick up its neighbours
+    static const uint32_t glyphPadding = 1;
+
+    GlyphCache::GlyphCache(const stbtt_fontinfo &fontInfo, float fontSize, uint32_t pageSize, uint32_t pageCount)
+        : fontInfo(fontInfo), pageSize(pageSize)
+    {
+        assert(pageSize > 0);
+        assert(pageCount > 0);
+
+        scaleFactor = stbtt_ScaleForPixelHeight(&fontInfo, fontSize);
+
+        pages.resize(pageCount);
+        for (Page &page : pages)
+        {
+            page.nextShelfY = 0;
+            page.pixels.assign(pageSize * pageSize * 4, 0);
+
+            textures.push_back(std::make_shared<Texture>(TextureType::Default, pageSize, pageSize,
+                &page.pixels[0], (uint32_t)page.pixels.size(), TextureFilter::Linear));
+        }
+    }
+
+    GlyphCache::~GlyphCache()
+    {
+    }
+
+    const CachedGlyph *GlyphCache::GetGlyph(int codePoint)
+    {
+        waitingForBatch = false;
+
+        auto found = glyphs.find(codePoint);
+        if (found == glyphs.end())
+        {
+            return AddGlyph(codePoint);
+        }
+
+        CachedGlyph &glyph = found->second;
+        if (glyph.fontGlyph == 0)
+        {
+            return nullptr;
+        }
+
+        if (!glyph.empty)
+        {
+            MarkUsed(shelves[glyph.shelf], false);
+        }
+
+        return &glyph;
+    }
+
+    void GlyphCache::Touch(uint32_t shelf, bool forBatch)
+    {
+        assert(shelf < shelves.size());
+        MarkUsed(shelves[shelf], forBatch);
+    }
+
+    void GlyphCache::MarkUsed(Shelf &shelf, bool forBatch)
+    {
+        shelf.lastUsed = useStamp;
+        if (forBatch)
+        {
+            shelf.batchSerial = textures[shelf.page]->GetBatchSerial();
+        }
+    }
+
+    bool GlyphCache::IsHeldForBatch(const Shelf &shelf) const
+    {
+        const Texture &texture = *textures[shelf.page];
+        return texture.IsHeldForBatch() && shelf.batchSerial == texture.GetBatchSerial();
+    }
+
+    const CachedGlyph *GlyphCache::AddGlyph(int codePoint)
+    {
+        CachedGlyph glyph = {};
+        glyph.fontGlyph = stbtt_FindGlyphIndex(&fontInfo, codePoint);
+
+        int advanceWidth, leftSideBearing;
+        stbtt_GetGlyphHMetrics(&fontInfo, glyph.fontGlyph, &advanceWidth, &leftSideBearing);
+        glyph.xadvance = advanceWidth * scaleFactor;
+
+        int x0, y0, x1, y1;
+        stbtt_GetGlyphBitmapBox(&fontInfo, glyph.fontGlyph, scaleFactor, scaleFactor, &x0, &y0, &x1, &y1);
+
+        uint32_t width = x1 > x0 ? (uint32_t)(x1 - x0) : 0;
+        uint32_t height = y1 > y0 ? (uint32_t)(y1 - y0) : 0;
+        uint32_t paddedWidth = width + glyphPadding * 2;
+        uint32_t paddedHeight = height + glyphPadding * 2;
+
+        // missing glyphs are remembered too, so they aren't looked up in the font again
+        if (glyph.fontGlyph == 0 || width == 0 || height == 0)
+        {
+            glyph.empty = true;
+            CachedGlyph &cachedGlyph = glyphs[codePoint] = glyph;
+            return glyph.fontGlyph == 0 ? nullptr : &cachedGlyph;
+        }
+
+        if (paddedWidth > pageSize || paddedHeight > pageSize)
+        {
+            spdlog::error("Glyph {} is too large for the glyph cache page size {}", codePoint, pageSize);
+            glyph.fontGlyph = 0;
+            glyphs[codePoint] = glyph;
+            return nullptr;
+        }
+
+        uint32_t shelfIndex, x, y;
+        if (!Allocate(paddedWidth, paddedHeight, shelfIndex, x, y))
+        {
+            spdlog::debug("Glyph cache is full, skipping glyph {}", codePoint);
+            return nullptr;
+        }
+
+        Shelf &shelf = shelves[shelfIndex];
+        shelf.codePoints.push_back(codePoint);
+        MarkUsed(shelf, false);
+
+        coverage.resize(width * height);
+        stbtt_MakeGlyphBitmap(
+            &fontInfo, &coverage[0], width, height, width, scaleFactor, scaleFactor, glyph.fontGlyph);
+
+        // expand to the same white with alpha layout CreateFontEntry uses, clearing the padding
+        std::vector<uint8_t> &pixels = pages[shelf.page].pixels;
+        for (uint32_t row = 0; row < paddedHeight; row++)
+        {
+            uint8_t *d = &pixels[((y + row) * pageSize + x) * 4];
+            memset(d, 0, paddedWidth * 4);
+
+            if (row < glyphPadding || row >= glyphPadding + height)
+            {
+                continue;
+            }
+
+            const uint8_t *s = &coverage[(row - glyphPadding) * width];
+            d += glyphPadding * 4;
+            for (uint32_t column = 0; column < width; column++)
+            {
+                *d++ = *s;
+                *d++ = *s;
+                *d++ = *s;
+                *d++ = *s;
+                s++;
+            }
+        }
+
+        textures[shelf.page]->QueueTextureData(
+            x, y, paddedWidth, paddedHeight, &pixels[(y * pageSize + x) * 4], pageSize);
+
+        float inverseSize = 1.0f / pageSize;
+        glyph.u0 = (x + glyphPadding) * inverseSize;
+        glyph.v0 = (y + glyphPadding) * inverseSize;
+        glyph.u1 = (x + glyphPadding + width) * inverseSize;
+        glyph.v1 = (y + glyphPadding + height) * inverseSize;
+        glyph.xoff = (float)x0;
+        glyph.yoff = (float)y0;
+        glyph.xoff2 = (float)x1;
+        glyph.yoff2 = (float)y1;
+        glyph.page = shelf.page;
+        glyph.shelf = shelfIndex;
+
+        return &(glyphs[codePoint] = glyph);
+    }
+
+    bool GlyphCache::Allocate(uint32_t width, uint32_t height, uint32_t &shelfIndex, uint32_t &x, uint32_t &y)
+    {
+        uint32_t shelfHeight = (height + shelfHeightStep - 1) / shelfHeightStep * shelfHeightStep;
+        uint32_t maximumShelfHeight = shelfHeight + shelfHeight / 2;
+
+        shelfIndex = UINT32_MAX;
+
+        // the first shelf of a suitable height that still has room
+        for (uint32_t i = 0; i < (uint32_t)shelves.size(); i++)
+        {
+            Shelf &shelf = shelves[i];
+            if (shelf.height >= shelfHeight && shelf.height <= maximumShelfHeight && shelf.x + width <= pageSize)
+            {
+                shelfIndex = i;
+                break;
+            }
+        }
+
+        // otherwise open a new shelf below the existing ones
+        if (shelfIndex == UINT32_MAX)
+        {
+            for (uint32_t page = 0; page < (uint32_t)pages.size(); page++)
+            {
+                if (pages[page].nextShelfY + shelfHeight <= pageSize)
+                {
+                    shelfIndex = (uint32_t)shelves.size();
+                    shelves.push_back({page, pages[page].nextShelfY, shelfHeight, 0, 0, UINT64_MAX, {}});
+                    pages[page].nextShelfY += shelfHeight;
+                    break;
+                }
+            }
+        }
+
+        // otherwise empty the least recently used shelf that's tall enough, as long as nothing
+        // still waiting to be drawn needs it
+        if (shelfIndex == UINT32_MAX)
+        {
+            bool heldForBatch = false;
+
+            for (uint32_t i = 0; i < (uint32_t)shelves.size(); i++)
+            {
+                Shelf &shelf = shelves[i];
+                if (shelf.height < shelfHeight || shelf.lastUsed == useStamp)
+                {
+                    continue;
+                }
+
+                if (IsHeldForBatch(shelf))
+                {
+                    heldForBatch = true;
+                    continue;
+                }
+
+                if (shelfIndex == UINT32_MAX || shelf.lastUsed < shelves[shelfIndex].lastUsed)
+                {
+                    shelfIndex = i;
+                }
+            }
+
+            if (shelfIndex == UINT32_MAX)
+            {
+                waitingForBatch = heldForBatch;
+                batchWaitCount += heldForBatch ? 1 : 0;
+                return false;
+            }
+
+            EvictShelf(shelves[shelfIndex]);
+        }
+
+        Shelf &shelf = shelves[shelfIndex];
+        x = shelf.x;
+        y = shelf.y;
+        shelf.x += width;
+
+        return true;
+    }
+
+    void GlyphCache::EvictShelf(Shelf &shelf)
+    {
+        for (int codePoint : shelf.codePoints)
+        {
+            glyphs.erase(codePoint);
+        }
+
+        shelf.codePoints.clear();
+        shelf.x = 0;
+        evictionCount++;
+    }
+} // namespace Lucky
@@ -0,0 +1,113 @@
+#include <assert.h>
+
+#include <Lucky/Graphics/PixelOperations.hpp>
+
+/* clang-format off */
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#include <emmintrin.h>
+	#define LUCKY_PIXELS_SSE2
+
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+	#include <arm_neon.h>
+	#define LUCKY_PIXELS_NEON
+
+#endif
+/* clang-format on */
+
+namespace Lucky
+{
+    // exact round(c * a / 255) without a division
+    static inline uint8_t MultiplyChannel(uint32_t c, uint32_t a)
+    {
+        uint32_t t = c * a + 128;
+        return (uint8_t)((t + (t >> 8)) >> 8);
+    }
+
+    void PremultiplyAlphaScalar(uint8_t *pixels, uint32_t pixelCount)
+    {
+        assert(pixels != nullptr || pixelCount == 0);
+
+        for (uint32_t i = 0; i < pixelCount; i++)
+        {
+            uint8_t *p = pixels + i * 4;
+            uint32_t a = p[3];
+
+            if (a == 255)
+            {
+                continue;
+            }
+
+            p[0] = MultiplyChannel(p[0], a);
+            p[1] = MultiplyChannel(p[1], a);
+            p[2] = MultiplyChannel(p[2], a);
+        }
+    }
+
+#if defined(LUCKY_PIXELS_SSE2)
+    // Two pixels widened to 16 bits per channel. The alpha lane is multiplied
+    // by 255 so it comes back out unchanged.
+    static inline __m128i PremultiplyTwoPixels(__m128i pixels, __m128i alphaLaneMask, __m128i alphaLaneOne)
+    {
+        __m128i alpha = _mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3));
+        alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+        alpha = _mm_or_si128(_mm_andnot_si128(alphaLaneMask, alpha), alphaLaneOne);
+
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(pixels, alpha), _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+#endif
+
+    void PremultiplyAlpha(uint8_t *pixels, uint32_t pixelCount)
+    {
+        assert(pixels != nullptr || pixelCount == 0);
+
+        uint32_t i = 0;
+
+#if defined(LUCKY_PIXELS_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i alphaLaneMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        const __m128i alphaLaneOne = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+        const __m128i opaque = _mm_set1_epi32((int)0xff000000);
+
+        for (; i + 4 <= pixelCount; i += 4)
+        {
+            __m128i *p = (__m128i *)(pixels + i * 4);
+            __m128i source = _mm_loadu_si128(p);
+
+            // fully opaque runs are common in sprite sheets, skip the work for them
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(source, opaque), opaque)) == 0xffff)
+            {
+                continue;
+            }
+
+            __m128i low = PremultiplyTwoPixels(_mm_unpacklo_epi8(source, zero), alphaLaneMask, alphaLaneOne);
+            __m128i high = PremultiplyTwoPixels(_mm_unpackhi_epi8(source, zero), alphaLaneMask, alphaLaneOne);
+            _mm_storeu_si128(p, _mm_packus_epi16(low, high));
+        }
+#elif defined(LUCKY_PIXELS_NEON)
+        for (; i + 16 <= pixelCount; i += 16)
+        {
+            uint8_t *p = pixels + i * 4;
+            uint8x16x4_t source = vld4q_u8(p);
+            uint8x16_t a = source.val[3];
+
+            for (int channel = 0; channel < 3; channel++)
+            {
+                uint8x16_t c = source.val[channel];
+
+                // (t + ((t + 128) >> 8) + 128) >> 8, the same rounding as the scalar path
+                uint16x8_t tLow = vmull_u8(vget_low_u8(c), vget_low_u8(a));
+                uint16x8_t tHigh = vmull_u8(vget_high_u8(c), vget_high_u8(a));
+                uint8x8_t low = vraddhn_u16(tLow, vrshrq_n_u16(tLow, 8));
+                uint8x8_t high = vraddhn_u16(tHigh, vrshrq_n_u16(tHigh, 8));
+
+                source.val[channel] = vcombine_u8(low, high);
+            }
+
+            vst4q_u8(p, source);
+        }
+#endif
+
+        PremultiplyAlphaScalar(pixels + i * 4, pixelCount - i);
+    }
+} // namespace Lucky
@@ -0,0 +1,76 @@
+#include <string.h>
+
+#include <Lucky/Graphics/SdfFontShader.hpp>
+
+namespace Lucky
+{
+    static const char *vertexShaderSource = // same as default BatchRenderer vert shader
+        "attribute vec4 position;\n"
+        "attribute vec4 color;\n"
+        "attribute vec2 texcoord;\n"
+        "varying vec4 v_color;\n"
+        "varying vec2 v_texcoord;\n"
+        "uniform mat4 ProjectionMatrix;\n"
+        //
+        "void main()\n"
+        "{\n"
+        "    gl_Position = ProjectionMatrix * position;\n"
+        "    v_color = color;\n"
+        "    v_texcoord = texcoord;\n"
+        "}\n";
+
+    static const char *fragmentShaderSource = //
+        "varying vec4 v_color;\n"
+        "varying vec2 v_texcoord;\n"
+        "uniform sampler2D TextureSampler;\n"
+        "uniform vec4 OutlineColor;\n"
+        "uniform float OutlineWidth;\n"
+        "uniform vec4 GlowColor;\n"
+        "uniform float GlowWidth;\n"
+        //
+        "void main()\n"
+        "{\n"
+        "    float fieldDistance = texture2D(TextureSampler, v_texcoord).a;\n"
+        // antialias over about a pixel at whatever size the text is drawn
+        "    float smoothing = max(fwidth(fieldDistance) * 0.5, 0.0001);\n"
+        "    float outlineEdge = 0.5 - OutlineWidth;\n"
+        //
+        "    float fill = smoothstep(0.5 - smoothing, 0.5 + smoothing, fieldDistance);\n"
+        "    float outline = smoothstep(outlineEdge - smoothing, outlineEdge + smoothing, fieldDistance);\n"
+        "    vec4 textColor = mix(OutlineColor, v_color, fill);\n"
+        "    textColor.a *= outline;\n"
+        //
+        "    float glowStart = outlineEdge - max(GlowWidth, 0.0001);\n"
+        "    float glow = smoothstep(glowStart, outlineEdge, fieldDistance) * GlowColor.a * (1.0 - textColor.a);\n"
+        // text over glow, premultiplied for the default blend mode
+        "    float alpha = clamp(textColor.a + glow, 0.0, 1.0);\n"
+        "    gl_FragColor = vec4(textColor.rgb * textColor.a + GlowColor.rgb * glow, alpha);\n"
+        "}\n";
+
+    SdfFontShader::SdfFontShader(std::shared_ptr<GraphicsDevice> graphicsDevice)
+    {
+        VertexShader vertexShader(vertexShaderSource, (uint32_t)strlen(vertexShaderSource));
+        FragmentShader fragmentShader(fragmentShaderSource, (uint32_t)strlen(fragmentShaderSource));
+
+        shaderProgram = std::make_shared<ShaderProgram>(graphicsDevice, vertexShader, fragmentShader);
+
+        SetOutline(0.0f, Color(0.0f, 0.0f, 0.0f, 1.0f));
+        SetGlow(0.0f, Color(0.0f, 0.0f, 0.0f, 0.0f));
+    }
+
+    SdfFontShader::~SdfFontShader()
+    {
+    }
+
+    void SdfFontShader::SetOutline(float width, const Color &color)
+    {
+        shaderProgram->SetParameter("OutlineWidth", width);
+        shaderProgram->SetParameter("OutlineColor", color.r, color.g, color.b, color.a);
+    }
+
+    void SdfFontShader::SetGlow(float width, const Color &color)
+    {
+        shaderProgram->SetParameter("GlowWidth", width);
+        shaderProgram->SetParameter("GlowColor", color.r, color.g, color.b, color.a);
+    }
+} // namespace Lucky
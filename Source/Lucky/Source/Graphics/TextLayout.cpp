@@ -0,0 +1,122 @@
+#include <assert.h>
+
+#include <functional>
+
+#include <Lucky/Graphics/Font.hpp>
+#include <Lucky/Graphics/GlyphCache.hpp>
+#include <Lucky/Graphics/TextLayout.hpp>
+
+namespace Lucky
+{
+    static inline size_t CombineHash(size_t hash, size_t value)
+    {
+        return hash ^ (value + 0x9E3779B9 + (hash << 6) + (hash >> 2));
+    }
+
+    void TextLayout::Draw(BatchRenderer &batchRenderer, float x, float y, const Color &color) const
+    {
+        if (vertices.empty())
+        {
+            return;
+        }
+
+        batchRenderer.BatchVertices(&vertices[0], (uint32_t)vertices.size(), glm::vec2(x, y), color);
+
+        // after batching, like DrawString, so a flush to fit the vertices doesn't release the shelves
+        if (glyphCache)
+        {
+            for (uint32_t shelf : shelves)
+            {
+                glyphCache->Touch(shelf, true);
+            }
+        }
+    }
+
+    TextLayoutCache::TextLayoutCache(uint32_t capacity)
+        : capacity(capacity)
+    {
+        assert(capacity > 0);
+    }
+
+    TextLayoutCache::~TextLayoutCache()
+    {
+    }
+
+    const TextLayout &TextLayoutCache::Get(
+        Font &font, const std::string &text, const std::string &entryName, const TextLayoutOptions &options)
+    {
+        size_t hash = std::hash<std::string>()(text);
+        hash = CombineHash(hash, std::hash<std::string>()(entryName));
+        hash = CombineHash(hash, std::hash<const Font *>()(&font));
+        hash = CombineHash(hash, (size_t)options.alignment);
+        hash = CombineHash(hash, std::hash<float>()(options.maximumWidth));
+        hash = CombineHash(hash, std::hash<float>()(options.lineSpacing));
+        hash = CombineHash(hash, std::hash<float>()(options.fontSize));
+
+        auto found = entries.find(hash);
+        if (found != entries.end())
+        {
+            CacheEntry &entry = found->second;
+            lru.splice(lru.begin(), lru, entry.lruPosition);
+
+            bool sameText = entry.font == &font && entry.options == options && entry.entryName == entryName &&
+                            entry.text == text;
+            if (sameText && font.IsLayoutCurrent(entry.layout, entryName))
+            {
+                return entry.layout;
+            }
+
+            if (!sameText)
+            {
+                entry.font = &font;
+                entry.entryName = entryName;
+                entry.text = text;
+                entry.options = options;
+            }
+
+            font.LayoutText(entry.layout, text, entryName, options);
+            layoutCount++;
+
+            return entry.layout;
+        }
+
+        if (entries.size() >= capacity)
+        {
+            entries.erase(lru.back());
+            lru.pop_back();
+        }
+
+        CacheEntry &entry = entries[hash];
+        entry.font = &font;
+        entry.entryName = entryName;
+        entry.text = text;
+        entry.options = options;
+
+        lru.push_front(hash);
+        entry.lruPosition = lru.begin();
+
+        font.LayoutText(entry.layout, text, entryName, options);
+        layoutCount++;
+
+        return entry.layout;
+    }
+
+    void TextLayoutCache::Draw(BatchRenderer &batchRenderer, Font &font, const std::string &text,
+        const std::string &entryName, float x, float y, const Color &color, const TextLayoutOptions &options)
+    {
+        const TextLayout *layout = &Get(font, text, entryName, options);
+        if (!font.IsLayoutCurrent(*layout, entryName))
+        {
+            batchRenderer.Flush();
+            layout = &Get(font, text, entryName, options);
+        }
+
+        layout->Draw(batchRenderer, x, y, color);
+    }
+
+    void TextLayoutCache::Clear()
+    {
+        entries.clear();
+        lru.clear();
+    }
+} // namespace Lucky
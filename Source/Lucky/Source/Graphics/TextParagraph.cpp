@@ -0,0 +1,228 @@
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include <Lucky/Graphics/GlyphCache.hpp>
+#include <Lucky/Graphics/TextParagraph.hpp>
+#include <Lucky/Utility/Utf8.hpp>
+
+namespace Lucky
+{
+    TextParagraph::TextParagraph()
+    {
+    }
+
+    TextParagraph::TextParagraph(const std::string &text)
+    {
+        SetText(text);
+    }
+
+    TextParagraph::~TextParagraph()
+    {
+    }
+
+    void TextParagraph::SetText(const std::string &text)
+    {
+        codePoints.clear();
+        DecodeUtf8(text, codePoints);
+
+        lines.clear();
+        dirty = true;
+        dirtyStart = 0;
+        dirtyEnd = (uint32_t)codePoints.size();
+    }
+
+    void TextParagraph::Insert(uint32_t index, const std::string &text)
+    {
+        assert(index <= codePoints.size());
+
+        size_t previousLength = codePoints.size();
+        DecodeUtf8(text, codePoints);
+
+        uint32_t count = (uint32_t)(codePoints.size() - previousLength);
+        if (count == 0)
+        {
+            return;
+        }
+
+        std::rotate(codePoints.begin() + index, codePoints.begin() + previousLength, codePoints.end());
+
+        // lines from the insertion on still hold the same text, just further along
+        for (Line &line : lines)
+        {
+            if (line.first >= index)
+            {
+                line.first += count;
+                line.last += count;
+                line.next += count;
+            }
+        }
+
+        if (dirty)
+        {
+            dirtyStart = dirtyStart > index ? dirtyStart + count : dirtyStart;
+            dirtyEnd = dirtyEnd >= index ? dirtyEnd + count : dirtyEnd;
+        }
+
+        MarkDirty(index, index + count);
+    }
+
+    void TextParagraph::Erase(uint32_t index, uint32_t count)
+    {
+        assert(index <= codePoints.size());
+
+        count = std::min(count, (uint32_t)codePoints.size() - index);
+        if (count == 0)
+        {
+            return;
+        }
+
+        uint32_t end = index + count;
+        codePoints.erase(codePoints.begin() + index, codePoints.begin() + end);
+
+        // lines that started in the erased text are gone, the ones after it move back
+        lines.erase(std::remove_if(lines.begin(), lines.end(),
+                        [&](const Line &line) { return line.first >= index && line.first < end; }),
+            lines.end());
+
+        for (Line &line : lines)
+        {
+            if (line.first >= end)
+            {
+                line.first -= count;
+                line.last -= count;
+                line.next -= count;
+            }
+        }
+
+        if (dirty)
+        {
+            dirtyStart = dirtyStart >= end ? dirtyStart - count : std::min(dirtyStart, index);
+            dirtyEnd = dirtyEnd >= end ? dirtyEnd - count : std::min(dirtyEnd, index);
+        }
+
+        MarkDirty(index, index);
+    }
+
+    void TextParagraph::MarkDirty(uint32_t start, uint32_t end)
+    {
+        dirtyStart = dirty ? std::min(dirtyStart, start) : start;
+        dirtyEnd = dirty ? std::max(dirtyEnd, end) : end;
+        dirty = true;
+    }
+
+    std::string TextParagraph::GetText() const
+    {
+        std::string text;
+        text.reserve(codePoints.size());
+
+        for (int codePoint : codePoints)
+        {
+            EncodeUtf8(codePoint, text);
+        }
+
+        return text;
+    }
+
+    uint32_t TextParagraph::FindLine(uint32_t index) const
+    {
+        // the last line starting at or before index
+        auto found = std::upper_bound(
+            lines.begin(), lines.end(), index, [](uint32_t index, const Line &line) { return index < line.first; });
+
+        return found == lines.begin() ? 0 : (uint32_t)(found - lines.begin() - 1);
+    }
+
+    glm::vec2 TextParagraph::GetCaretPosition(uint32_t index) const
+    {
+        if (lines.empty())
+        {
+            return glm::vec2(0.0f, 0.0f);
+        }
+
+        uint32_t lineIndex = FindLine(index);
+        const Line &line = lines[lineIndex];
+
+        // carets in the space or '\n' a line broke at sit at its end
+        uint32_t caret = index > line.first ? std::min(index - line.first, (uint32_t)line.carets.size() - 1) : 0;
+
+        return glm::vec2(line.carets[caret], lineIndex * lineHeight);
+    }
+
+    uint32_t TextParagraph::FindIndex(float x, float y) const
+    {
+        if (lines.empty())
+        {
+            return 0;
+        }
+
+        float row = floorf((y - lineTop) / lineHeight);
+        uint32_t lineIndex = (uint32_t)std::min(std::max(row, 0.0f), (float)(lines.size() - 1));
+        const Line &line = lines[lineIndex];
+
+        auto found = std::lower_bound(line.carets.begin(), line.carets.end(), x);
+        if (found == line.carets.end())
+        {
+            return line.last;
+        }
+
+        if (found != line.carets.begin() && x - *(found - 1) < *found - x)
+        {
+            --found;
+        }
+
+        return line.first + (uint32_t)(found - line.carets.begin());
+    }
+
+    void TextParagraph::Draw(BatchRenderer &batchRenderer, float x, float y, const Color &color) const
+    {
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            DrawLine(batchRenderer, i, x, y, color);
+        }
+    }
+
+    void TextParagraph::Draw(
+        BatchRenderer &batchRenderer, float x, float y, const Color &color, float top, float bottom) const
+    {
+        if (lines.empty() || lineHeight <= 0.0f)
+        {
+            return;
+        }
+
+        // lines are lineHeight apart, so the visible ones can be found without looking at any
+        float firstRow = floorf((top - y - lineBottom) / lineHeight) + 1.0f;
+        float lastRow = floorf((bottom - y - lineTop) / lineHeight);
+
+        size_t first = (size_t)std::max(firstRow, 0.0f);
+        size_t last = (size_t)std::min(std::max(lastRow + 1.0f, 0.0f), (float)lines.size());
+
+        for (size_t i = first; i < last; i++)
+        {
+            DrawLine(batchRenderer, i, x, y, color);
+        }
+    }
+
+    void TextParagraph::DrawLine(
+        BatchRenderer &batchRenderer, size_t index, float x, float y, const Color &color) const
+    {
+        const Line &line = lines[index];
+        if (line.vertices.empty())
+        {
+            return;
+        }
+
+        batchRenderer.BatchVertices(
+            &line.vertices[0], (uint32_t)line.vertices.size(), glm::vec2(x, y + index * lineHeight), color);
+
+        // like TextLayout, only once the vertices are in the batch
+        if (glyphCache)
+        {
+            for (uint32_t shelf : line.shelves)
+            {
+                glyphCache->Touch(shelf, true);
+            }
+        }
+    }
+} // namespace Lucky
@@ -1,17 +1,22 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include <spdlog/spdlog.h>
 #include <stb_image.h>
 
+#include <Lucky/Graphics/PixelOperations.hpp>
 #include <Lucky/Graphics/Texture.hpp>
 
 #include "IncludeOpenGL.h"
 
 namespace Lucky
 {
-    Texture::Texture(const std::string &filename, TextureFilter textureFilter, TextureFormat textureFormat)
+    Texture::Texture(const std::string &filename, TextureFilter textureFilter, TextureFormat textureFormat,
+        TextureAlphaMode alphaMode)
     {
         int imageWidth, imageHeight, imageChannels;
         uint8_t *imagePixels =
@@ -22,12 +27,18 @@ namespace Lucky
             throw;
         }
 
+        if (alphaMode == TextureAlphaMode::Premultiplied)
+        {
+            PremultiplyAlpha(imagePixels, imageWidth * imageHeight);
+        }
+
         Initialize(TextureType::Default, imageWidth, imageHeight, imagePixels,
             imageWidth * imageHeight * 4, textureFilter, textureFormat);
         stbi_image_free(imagePixels);
     }
 
-    Texture::Texture(uint8_t *memory, uint32_t memoryLength, TextureFilter textureFilter, TextureFormat textureFormat)
+    Texture::Texture(uint8_t *memory, uint32_t memoryLength, TextureFilter textureFilter, TextureFormat textureFormat,
+        TextureAlphaMode alphaMode)
     {
         assert(memory != nullptr);
 
@@ -40,6 +51,11 @@ namespace Lucky
             throw;
         }
 
+        if (alphaMode == TextureAlphaMode::Premultiplied)
+        {
+            PremultiplyAlpha(imagePixels, imageWidth * imageHeight);
+        }
+
         Initialize(TextureType::Default, imageWidth, imageHeight, imagePixels, imageWidth * imageHeight * 4,
             textureFilter, textureFormat);
         stbi_image_free(imagePixels);
@@ -64,6 +80,7 @@ namespace Lucky
         this->width = width;
         this->height = height;
         this->textureType = textureType;
+        this->textureFormat = textureFormat;
 
         glGenTextures(1, &textureId);
 
@@ -104,6 +121,11 @@ namespace Lucky
             glDeleteFramebuffers(1, &fbo);
         }
 
+        if (pbo != 0)
+        {
+            glDeleteBuffers(1, &pbo);
+        }
+
         glDeleteTextures(1, &textureId);
     }
 
@@ -119,6 +141,183 @@ namespace Lucky
         glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixelData);
     }
 
+    void Texture::QueueTextureData(
+        uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t *pixelData, uint32_t rowStride)
+    {
+        assert(pixelData != nullptr);
+        assert(x + w <= width);
+        assert(y + h <= height);
+        assert(rowStride >= w);
+
+        if (w == 0 || h == 0)
+        {
+            return;
+        }
+
+        pendingUpdates.push_back({x, y, w, h, pixelData, rowStride});
+    }
+
+    void Texture::CoalescePendingUpdates()
+    {
+        // Regions are uploaded in the order they were queued, since a later region may overwrite
+        // an earlier one. Each region is folded into the last one queued from the same source
+        // image, meaning the same row stride and the same address for texel (0, 0), when the two
+        // touch and the combined rectangle doesn't upload much more than the two separately. The
+        // combined rectangle moves the upload earlier and also covers texels of the image that
+        // weren't queued, so the merge is skipped when it overlaps any region of another image.
+        auto imageOrigin = [](const PendingUpdate &u) {
+            return (intptr_t)u.pixelData - ((intptr_t)u.y * u.rowStride + u.x) * 4;
+        };
+
+        auto overlaps = [](const PendingUpdate &u, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) {
+            return u.x < x1 && x0 < u.x + u.w && u.y < y1 && y0 < u.y + u.h;
+        };
+
+        size_t count = 0;
+        for (size_t i = 0; i < pendingUpdates.size(); i++)
+        {
+            const PendingUpdate &b = pendingUpdates[i];
+            intptr_t origin = imageOrigin(b);
+
+            size_t target = count;
+            while (target > 0)
+            {
+                const PendingUpdate &candidate = pendingUpdates[target - 1];
+                if (candidate.rowStride == b.rowStride && imageOrigin(candidate) == origin)
+                {
+                    break;
+                }
+
+                target--;
+            }
+
+            if (target > 0)
+            {
+                PendingUpdate &a = pendingUpdates[target - 1];
+
+                bool touching = !(a.x > b.x + b.w || b.x > a.x + a.w || a.y > b.y + b.h || b.y > a.y + a.h);
+                if (touching)
+                {
+                    uint32_t x0 = std::min(a.x, b.x);
+                    uint32_t y0 = std::min(a.y, b.y);
+                    uint32_t x1 = std::max(a.x + a.w, b.x + b.w);
+                    uint32_t y1 = std::max(a.y + a.h, b.y + b.h);
+
+                    uint64_t mergedArea = (uint64_t)(x1 - x0) * (y1 - y0);
+                    uint64_t separateArea = (uint64_t)a.w * a.h + (uint64_t)b.w * b.h;
+
+                    bool clear = mergedArea <= separateArea * 2;
+                    for (size_t j = 0; clear && j < count; j++)
+                    {
+                        const PendingUpdate &other = pendingUpdates[j];
+                        bool foreign = other.rowStride != b.rowStride || imageOrigin(other) != origin;
+                        if (foreign && overlaps(other, x0, y0, x1, y1))
+                        {
+                            clear = false;
+                        }
+                    }
+
+                    if (clear)
+                    {
+                        a.pixelData += ((intptr_t)y0 - a.y) * a.rowStride * 4 + ((intptr_t)x0 - a.x) * 4;
+                        a.x = x0;
+                        a.y = y0;
+                        a.w = x1 - x0;
+                        a.h = y1 - y0;
+                        continue;
+                    }
+                }
+            }
+
+            pendingUpdates[count++] = b;
+        }
+
+        pendingUpdates.resize(count);
+    }
+
+    void Texture::FlushTextureUpdates()
+    {
+        if (pendingUpdates.empty())
+        {
+            return;
+        }
+
+        CoalescePendingUpdates();
+
+        size_t totalBytes = 0;
+        for (const auto &update : pendingUpdates)
+        {
+            totalBytes += (size_t)update.w * update.h * 4;
+        }
+
+        if (pbo == 0)
+        {
+            glGenBuffers(1, &pbo);
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+
+        // orphan the previous contents so we don't wait on last frame's transfer
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, totalBytes, nullptr, GL_STREAM_DRAW);
+        uint8_t *mapped = (uint8_t *)glMapBufferRange(
+            GL_PIXEL_UNPACK_BUFFER, 0, totalBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped == nullptr)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            spdlog::error("Failed to map texture upload buffer");
+            throw;
+        }
+
+        uint8_t *destination = mapped;
+        for (const auto &update : pendingUpdates)
+        {
+            const uint8_t *source = update.pixelData;
+            size_t rowBytes = (size_t)update.w * 4;
+
+            for (uint32_t row = 0; row < update.h; row++)
+            {
+                memcpy(destination, source, rowBytes);
+                destination += rowBytes;
+                source += (size_t)update.rowStride * 4;
+            }
+        }
+
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glBindTexture(GL_TEXTURE_2D, textureId);
+
+        size_t offset = 0;
+        for (const auto &update : pendingUpdates)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, update.x, update.y, update.w, update.h, GL_RGBA, GL_UNSIGNED_BYTE,
+                (const void *)offset);
+            offset += (size_t)update.w * update.h * 4;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        pendingUpdates.clear();
+    }
+
+    uint64_t Texture::GetMemorySize() const
+    {
+        return (uint64_t)width * height * BytesPerPixel(textureFormat);
+    }
+
+    uint32_t Texture::BytesPerPixel(TextureFormat textureFormat)
+    {
+        switch (textureFormat)
+        {
+        case TextureFormat::Normal: // GL_RGBA8
+        case TextureFormat::HDR:    // GL_R11F_G11F_B10F
+            return 4;
+
+        default:
+            spdlog::error("Unsupported TextureFormat type.");
+            throw;
+        }
+    }
+
     void Texture::SetTextureFilter(TextureFilter filter)
     {
         textureFilter = filter;
@@ -1,73 +1,507 @@
 #include <fstream>
+#include <future>
 #include <stdexcept>
+#include <string.h>
 
-#include <rapidjson/document.h>
+#include <rapidjson/memorystream.h>
+#include <rapidjson/reader.h>
 #include <spdlog/spdlog.h>
+#include <stb_image.h>
 
 // #include <Lucky/Content/Content.hpp>
+#include <Lucky/Graphics/PixelOperations.hpp>
 #include <Lucky/Graphics/TextureAtlas.hpp>
 #include <Lucky/Math/MathHelpers.hpp>
 #include <Lucky/Utility/FileSystem.hpp>
 
 namespace Lucky
 {
-    TextureAtlas::TextureAtlas(const std::string &fileName)
+    static const char binaryAtlasMagic[4] = {'L', 'K', 'T', 'A'};
+    static const uint32_t binaryAtlasVersion = 2;
+
+    struct BinaryAtlasHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t regionCount;
+        uint32_t regionsOffset;
+        uint32_t pageCount;
+        uint32_t pagesOffset;
+        uint32_t stringTableOffset;
+        uint32_t stringTableSize;
+    };
+
+    struct BinaryAtlasPage
+    {
+        uint32_t imageNameOffset;
+        uint32_t imageNameLength;
+    };
+
+    struct BinaryAtlasRegion
+    {
+        int32_t bounds[4];
+        int32_t input[4];
+        float originTopLeft[2];
+        float originBottomRight[2];
+        float originCenter[2];
+        float pivot[2];
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t flags;
+        uint32_t page;
+    };
+
+    static const uint32_t binaryRegionRotated = 1 << 0;
+
+    static_assert(sizeof(BinaryAtlasHeader) == 32, "BinaryAtlasHeader must not contain padding");
+    static_assert(sizeof(BinaryAtlasPage) == 8, "BinaryAtlasPage must not contain padding");
+    static_assert(sizeof(BinaryAtlasRegion) == 80, "BinaryAtlasRegion must not contain padding");
+
+    // FNV-1a
+    static uint32_t HashName(std::string_view name)
     {
-        std::ifstream stream(fileName, std::ios::in | std::ios::binary);
+        uint32_t hash = 2166136261u;
+        for (char c : name)
+        {
+            hash ^= (uint8_t)c;
+            hash *= 16777619u;
+        }
+
+        return hash;
+    }
+
+    static bool IsBinaryAtlas(const uint8_t *buffer, uint64_t bufferLength)
+    {
+        return bufferLength >= sizeof(BinaryAtlasHeader) &&
+               memcmp(buffer, binaryAtlasMagic, sizeof(binaryAtlasMagic)) == 0;
+    }
+
+    // Reads a whole atlas file, with one extra byte so the JSON can be parsed in place
+    // as a null terminated string
+    static std::vector<char> ReadAtlasFile(const std::string &fileName, uint64_t &fileSize)
+    {
+        std::ifstream stream(fileName, std::ios::in | std::ios::binary | std::ios::ate);
         if (!stream)
         {
             spdlog::error("Failed to load texture dictionary file: {}", fileName);
             throw;
         }
 
-        std::vector<uint8_t> buffer(
-            (std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
-        if (buffer.size() == 0)
+        std::streamsize size = stream.tellg();
+        stream.seekg(0, std::ios::beg);
+
+        std::vector<char> buffer((size_t)std::max<std::streamsize>(size, 0) + 1);
+        if (size <= 0 || !stream.read(buffer.data(), size))
         {
             spdlog::error("Failed to read texture dictionary: {}", fileName);
             throw;
         }
+        buffer[(size_t)size] = 0;
 
-        Initialize(buffer.data(), buffer.size(), fileName);
+        fileSize = (uint64_t)size;
+        return buffer;
     }
 
-    TextureAtlas::TextureAtlas(uint8_t *buffer, uint64_t bufferLength, const std::string &fileName)
+    // SAX handler for TexturePacker's JSON output. It walks the document once and
+    // only keeps the values it needs, instead of building a DOM and looking every
+    // member up by name for each frame.
+    struct TextureAtlas::JsonHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, JsonHandler>
     {
-        Initialize(buffer, bufferLength, fileName);
-    }
+        enum class Scope
+        {
+            Root,
+            FramesArray,
+            FramesObject,
+            Frame,
+            FrameRectangle,
+            SpriteSourceSize,
+            SourceSize,
+            Pivot,
+            Meta,
+            TexturesArray,
+            Texture,
+            RelatedMultiPacks,
+            Ignored,
+        };
 
-    void TextureAtlas::Initialize(
-        uint8_t *buffer, uint64_t bufferLength, const std::string &fileName)
-    {
-        rapidjson::Document jsonDocument;
+        enum class Field
+        {
+            None,
+            Frames,
+            Meta,
+            Textures,
+            RelatedMultiPacks,
+            Image,
+            FileName,
+            Frame,
+            Rotated,
+            SpriteSourceSize,
+            SourceSize,
+            Pivot,
+            X,
+            Y,
+            W,
+            H,
+        };
 
-        auto &x = jsonDocument.Parse((char *)buffer, (size_t)bufferLength);
-        if (x.HasParseError())
+        enum RequiredFields
         {
-            spdlog::error("JSON parsing failed for file: {}", fileName);
-            throw;
+            HasFileName = 1 << 0,
+            HasFrame = 1 << 1,
+            HasSpriteSourceSize = 1 << 2,
+            HasSourceSize = 1 << 3,
+        };
+
+        struct FrameData
+        {
+            std::string name;
+            float frame[4];
+            float spriteSourceSize[4];
+            float sourceSize[2];
+            glm::vec2 pivot;
+            bool rotated;
+            uint32_t fieldsFound;
+        };
+
+        JsonHandler(TextureAtlas &atlas, uint32_t firstPage)
+            : atlas(atlas), firstPage(firstPage), page(firstPage)
+        {
+            scopes.reserve(8);
         }
 
-        auto &frames = jsonDocument["frames"];
+        Scope CurrentScope() const
+        {
+            return scopes.empty() ? Scope::Root : scopes.back();
+        }
 
-        for (auto &frame : frames.GetArray())
+        bool StartObject()
         {
-            std::string name = frame["filename"].GetString();
+            if (!started)
+            {
+                started = true;
+                scopes.push_back(Scope::Root);
+                return true;
+            }
 
-            TextureRegion textureRegion;
-            textureRegion.bounds.x = frame["frame"]["x"].GetInt();
-            textureRegion.bounds.y = frame["frame"]["y"].GetInt();
-            textureRegion.bounds.width = frame["frame"]["w"].GetInt();
-            textureRegion.bounds.height = frame["frame"]["h"].GetInt();
-            textureRegion.rotated = frame["rotated"].GetBool();
+            Scope scope = CurrentScope();
+            Scope next = Scope::Ignored;
+
+            if (scope == Scope::Root && field == Field::Meta)
+            {
+                next = Scope::Meta;
+            }
+            else if ((scope == Scope::Root || scope == Scope::Texture) && field == Field::Frames)
+            {
+                next = Scope::FramesObject;
+            }
+            else if (scope == Scope::TexturesArray)
+            {
+                // each entry of the "textures" array is its own page
+                page = firstPage + textureCount++;
+                SetPageCount(page + 1);
+                next = Scope::Texture;
+            }
+            else if (scope == Scope::FramesArray || scope == Scope::FramesObject)
+            {
+                // in the hash format the frame's key is its name, and was already stored by Key()
+                BeginFrame(scope == Scope::FramesObject);
+                next = Scope::Frame;
+            }
+            else if (scope == Scope::Frame)
+            {
+                switch (field)
+                {
+                case Field::Frame:
+                    next = Scope::FrameRectangle;
+                    frame.fieldsFound |= HasFrame;
+                    break;
+                case Field::SpriteSourceSize:
+                    next = Scope::SpriteSourceSize;
+                    frame.fieldsFound |= HasSpriteSourceSize;
+                    break;
+                case Field::SourceSize:
+                    next = Scope::SourceSize;
+                    frame.fieldsFound |= HasSourceSize;
+                    break;
+                case Field::Pivot:
+                    next = Scope::Pivot;
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            scopes.push_back(next);
+            field = Field::None;
+            return true;
+        }
+
+        bool EndObject(rapidjson::SizeType)
+        {
+            Scope scope = CurrentScope();
+            scopes.pop_back();
+            field = Field::None;
+
+            if (scope == Scope::Frame)
+            {
+                return EndFrame();
+            }
+
+            return true;
+        }
+
+        bool StartArray()
+        {
+            Scope scope = CurrentScope();
+            Scope next = Scope::Ignored;
+
+            if ((scope == Scope::Root || scope == Scope::Texture) && field == Field::Frames)
+            {
+                next = Scope::FramesArray;
+            }
+            else if (scope == Scope::Root && field == Field::Textures)
+            {
+                next = Scope::TexturesArray;
+            }
+            else if (scope == Scope::Meta && field == Field::RelatedMultiPacks)
+            {
+                next = Scope::RelatedMultiPacks;
+            }
+
+            scopes.push_back(next);
+            field = Field::None;
+            return true;
+        }
+
+        bool EndArray(rapidjson::SizeType)
+        {
+            scopes.pop_back();
+            field = Field::None;
+            return true;
+        }
+
+        bool Key(const char *str, rapidjson::SizeType length, bool)
+        {
+            std::string_view key(str, length);
+            field = Field::None;
+
+            switch (CurrentScope())
+            {
+            case Scope::Root:
+                if (key == "frames")
+                    field = Field::Frames;
+                else if (key == "meta")
+                    field = Field::Meta;
+                else if (key == "textures")
+                    field = Field::Textures;
+                break;
+
+            case Scope::Texture:
+                if (key == "frames")
+                    field = Field::Frames;
+                else if (key == "image")
+                    field = Field::Image;
+                break;
+
+            case Scope::FramesObject:
+                frameKey.assign(str, length);
+                break;
+
+            case Scope::Frame:
+                if (key == "filename")
+                    field = Field::FileName;
+                else if (key == "frame")
+                    field = Field::Frame;
+                else if (key == "rotated")
+                    field = Field::Rotated;
+                else if (key == "spriteSourceSize")
+                    field = Field::SpriteSourceSize;
+                else if (key == "sourceSize")
+                    field = Field::SourceSize;
+                else if (key == "pivot")
+                    field = Field::Pivot;
+                break;
+
+            case Scope::FrameRectangle:
+            case Scope::SpriteSourceSize:
+            case Scope::SourceSize:
+            case Scope::Pivot:
+                if (key == "x")
+                    field = Field::X;
+                else if (key == "y")
+                    field = Field::Y;
+                else if (key == "w")
+                    field = Field::W;
+                else if (key == "h")
+                    field = Field::H;
+                break;
 
-            float spriteSourceSizeX = frame["spriteSourceSize"]["x"].GetFloat();
-            float spriteSourceSizeY = frame["spriteSourceSize"]["y"].GetFloat();
-            float spriteSourceSizeW = frame["spriteSourceSize"]["w"].GetFloat();
-            float spriteSourceSizeH = frame["spriteSourceSize"]["h"].GetFloat();
+            case Scope::Meta:
+                if (key == "image")
+                    field = Field::Image;
+                else if (key == "related_multi_packs")
+                    field = Field::RelatedMultiPacks;
+                break;
 
-            float sourceSizeW = frame["sourceSize"]["w"].GetFloat();
-            float sourceSizeH = frame["sourceSize"]["h"].GetFloat();
+            default:
+                break;
+            }
+
+            return true;
+        }
+
+        bool Number(float value)
+        {
+            if (field != Field::X && field != Field::Y && field != Field::W && field != Field::H)
+            {
+                field = Field::None;
+                return true;
+            }
+
+            int component = field == Field::X ? 0 : field == Field::Y ? 1 : field == Field::W ? 2 : 3;
+
+            switch (CurrentScope())
+            {
+            case Scope::FrameRectangle:
+                frame.frame[component] = value;
+                break;
+            case Scope::SpriteSourceSize:
+                frame.spriteSourceSize[component] = value;
+                break;
+            case Scope::SourceSize:
+                if (component >= 2)
+                {
+                    frame.sourceSize[component - 2] = value;
+                }
+                break;
+            case Scope::Pivot:
+                if (component < 2)
+                {
+                    frame.pivot[component] = value;
+                }
+                break;
+            default:
+                break;
+            }
+
+            field = Field::None;
+            return true;
+        }
+
+        bool Int(int value)
+        {
+            return Number((float)value);
+        }
+
+        bool Uint(unsigned value)
+        {
+            return Number((float)value);
+        }
+
+        bool Int64(int64_t value)
+        {
+            return Number((float)value);
+        }
+
+        bool Uint64(uint64_t value)
+        {
+            return Number((float)value);
+        }
+
+        bool Double(double value)
+        {
+            return Number((float)value);
+        }
+
+        bool Bool(bool value)
+        {
+            if (CurrentScope() == Scope::Frame && field == Field::Rotated)
+            {
+                frame.rotated = value;
+            }
+
+            field = Field::None;
+            return true;
+        }
+
+        bool String(const char *str, rapidjson::SizeType length, bool)
+        {
+            Scope scope = CurrentScope();
+
+            if (scope == Scope::Frame && field == Field::FileName)
+            {
+                frame.name.assign(str, length);
+                frame.fieldsFound |= HasFileName;
+            }
+            else if (scope == Scope::Texture && field == Field::Image)
+            {
+                atlas.imageNames[page].assign(str, length);
+            }
+            else if (scope == Scope::Meta && field == Field::Image && textureCount == 0)
+            {
+                SetPageCount(firstPage + 1);
+                atlas.imageNames[firstPage].assign(str, length);
+            }
+            else if (scope == Scope::RelatedMultiPacks)
+            {
+                relatedMultiPacks.emplace_back(str, length);
+            }
+
+            field = Field::None;
+            return true;
+        }
+
+        bool Default()
+        {
+            field = Field::None;
+            return true;
+        }
+
+        void SetPageCount(uint32_t pageCount)
+        {
+            if (atlas.imageNames.size() < pageCount)
+            {
+                atlas.imageNames.resize(pageCount);
+            }
+        }
+
+        void BeginFrame(bool nameFromKey)
+        {
+            frame.rotated = false;
+            frame.pivot = {0.5f, 0.5f};
+            frame.fieldsFound = 0;
+
+            if (nameFromKey)
+            {
+                frame.name = frameKey;
+                frame.fieldsFound |= HasFileName;
+            }
+        }
+
+        bool EndFrame()
+        {
+            const uint32_t required = HasFileName | HasFrame | HasSpriteSourceSize | HasSourceSize;
+            if ((frame.fieldsFound & required) != required)
+            {
+                spdlog::error("Texture atlas frame is missing required fields: {}", frame.name);
+                return false;
+            }
+
+            float spriteSourceSizeX = frame.spriteSourceSize[0];
+            float spriteSourceSizeY = frame.spriteSourceSize[1];
+            float spriteSourceSizeW = frame.spriteSourceSize[2];
+            float spriteSourceSizeH = frame.spriteSourceSize[3];
+
+            float sourceSizeW = frame.sourceSize[0];
+            float sourceSizeH = frame.sourceSize[1];
+
+            TextureRegion textureRegion;
+            textureRegion.bounds.x = (int)frame.frame[0];
+            textureRegion.bounds.y = (int)frame.frame[1];
+            textureRegion.bounds.width = (int)frame.frame[2];
+            textureRegion.bounds.height = (int)frame.frame[3];
+            textureRegion.rotated = frame.rotated;
+            textureRegion.page = page;
 
             textureRegion.originTopLeft.x = -spriteSourceSizeX / spriteSourceSizeW;
             textureRegion.originTopLeft.y = -spriteSourceSizeY / spriteSourceSizeH;
@@ -80,45 +514,418 @@ namespace Lucky
             textureRegion.originCenter =
                 (textureRegion.originTopLeft + textureRegion.originBottomRight) / 2.0f;
 
-            glm::vec2 pivot = {0.5f, 0.5f};
-            if (frame.HasMember("pivot"))
-            {
-                pivot.x = frame["pivot"]["x"].GetFloat();
-                pivot.y = frame["pivot"]["y"].GetFloat();
-            }
-
             textureRegion.pivot.x = Lerp<float>(
-                textureRegion.originTopLeft.x, textureRegion.originBottomRight.x, pivot.x);
+                textureRegion.originTopLeft.x, textureRegion.originBottomRight.x, frame.pivot.x);
             textureRegion.pivot.y = Lerp<float>(
-                textureRegion.originTopLeft.y, textureRegion.originBottomRight.y, pivot.y);
+                textureRegion.originTopLeft.y, textureRegion.originBottomRight.y, frame.pivot.y);
 
             textureRegion.input.x = (int)spriteSourceSizeX;
             textureRegion.input.y = (int)spriteSourceSizeY;
             textureRegion.input.width = (int)sourceSizeW;
             textureRegion.input.height = (int)sourceSizeH;
 
-            dictionary[name] = textureRegion;
+            SetPageCount(page + 1);
+            atlas.AddRegion(frame.name, textureRegion);
+            return true;
         }
 
-        auto &meta = jsonDocument["meta"];
-        texturePath = CombinePaths(GetPathName(fileName), meta["image"].GetString());
+        TextureAtlas &atlas;
+        std::vector<Scope> scopes;
+        Field field = Field::None;
+        bool started = false;
+
+        uint32_t firstPage;
+        uint32_t page;
+        uint32_t textureCount = 0;
+        std::vector<std::string> relatedMultiPacks;
+
+        FrameData frame;
+        std::string frameKey;
+    };
+
+    void TextureAtlas::ConvertToBinary(const std::string &jsonFileName, const std::string &binaryFileName)
+    {
+        TextureAtlas atlas(jsonFileName);
+        atlas.SaveBinary(binaryFileName);
     }
 
-    bool TextureAtlas::Contains(const std::string &textureName) const
+    TextureAtlas::TextureAtlas(const std::string &fileName)
     {
-        return dictionary.find(textureName) != dictionary.end();
+        uint64_t fileSize;
+        std::vector<char> buffer = ReadAtlasFile(fileName, fileSize);
+
+        if (IsBinaryAtlas((const uint8_t *)buffer.data(), fileSize))
+        {
+            InitializeBinary((const uint8_t *)buffer.data(), fileSize, fileName);
+        }
+        else
+        {
+            InitializeJson(buffer.data(), fileSize, true, fileName, true);
+        }
+    }
+
+    TextureAtlas::TextureAtlas(uint8_t *buffer, uint64_t bufferLength, const std::string &fileName)
+    {
+        if (IsBinaryAtlas(buffer, bufferLength))
+        {
+            InitializeBinary(buffer, bufferLength, fileName);
+        }
+        else
+        {
+            // the caller owns this buffer, so parse without modifying it
+            InitializeJson((char *)buffer, bufferLength, false, fileName, true);
+        }
+    }
+
+    void TextureAtlas::InitializeJson(
+        char *buffer, uint64_t bufferLength, bool insitu, const std::string &fileName, bool loadRelatedPacks)
+    {
+        JsonHandler handler(*this, (uint32_t)imageNames.size());
+        rapidjson::Reader reader;
+        rapidjson::ParseResult result;
+
+        if (insitu)
+        {
+            rapidjson::InsituStringStream stream(buffer);
+            result = reader.Parse<rapidjson::kParseInsituFlag>(stream, handler);
+        }
+        else
+        {
+            rapidjson::MemoryStream stream(buffer, (size_t)bufferLength);
+            result = reader.Parse(stream, handler);
+        }
+
+        if (result.IsError())
+        {
+            spdlog::error("JSON parsing failed for file: {}", fileName);
+            throw;
+        }
+
+        // an atlas without an image name still has the one page
+        if (imageNames.empty())
+        {
+            imageNames.resize(1);
+        }
+
+        std::string pathName = GetPathName(fileName);
+        for (size_t page = texturePaths.size(); page < imageNames.size(); page++)
+        {
+            texturePaths.push_back(CombinePaths(pathName, imageNames[page]));
+        }
+
+        // every pack of a multipack atlas lists all the others, only follow the links from the first one
+        if (loadRelatedPacks)
+        {
+            for (const std::string &relatedPack : handler.relatedMultiPacks)
+            {
+                std::string relatedFileName = CombinePaths(pathName, relatedPack);
+
+                uint64_t fileSize;
+                std::vector<char> relatedBuffer = ReadAtlasFile(relatedFileName, fileSize);
+                InitializeJson(relatedBuffer.data(), fileSize, true, relatedFileName, false);
+            }
+        }
+    }
+
+    void TextureAtlas::InitializeBinary(const uint8_t *buffer, uint64_t bufferLength, const std::string &fileName)
+    {
+        BinaryAtlasHeader header;
+        memcpy(&header, buffer, sizeof(header));
+
+        if (header.version != binaryAtlasVersion)
+        {
+            spdlog::error("Unsupported binary texture atlas version {}: {}", header.version, fileName);
+            throw;
+        }
+
+        uint64_t regionsEnd = (uint64_t)header.regionsOffset + (uint64_t)header.regionCount * sizeof(BinaryAtlasRegion);
+        uint64_t pagesEnd = (uint64_t)header.pagesOffset + (uint64_t)header.pageCount * sizeof(BinaryAtlasPage);
+        uint64_t stringTableEnd = (uint64_t)header.stringTableOffset + header.stringTableSize;
+
+        if (regionsEnd > bufferLength || pagesEnd > bufferLength || stringTableEnd > bufferLength)
+        {
+            spdlog::error("Invalid binary texture atlas: {}", fileName);
+            throw;
+        }
+
+        const char *stringTable = (const char *)buffer + header.stringTableOffset;
+        std::string pathName = GetPathName(fileName);
+
+        imageNames.reserve(header.pageCount);
+        texturePaths.reserve(header.pageCount);
+
+        for (uint32_t i = 0; i < header.pageCount; i++)
+        {
+            BinaryAtlasPage record;
+            memcpy(&record, buffer + header.pagesOffset + i * sizeof(BinaryAtlasPage), sizeof(record));
+
+            if ((uint64_t)record.imageNameOffset + record.imageNameLength > header.stringTableSize)
+            {
+                spdlog::error("Invalid page image name in binary texture atlas: {}", fileName);
+                throw;
+            }
+
+            imageNames.emplace_back(stringTable + record.imageNameOffset, record.imageNameLength);
+            texturePaths.push_back(CombinePaths(pathName, imageNames.back()));
+        }
+
+        regions.reserve(header.regionCount);
+        regionNames.reserve(header.regionCount);
+        regionHashes.reserve(header.regionCount);
+
+        for (uint32_t i = 0; i < header.regionCount; i++)
+        {
+            BinaryAtlasRegion record;
+            memcpy(&record, buffer + header.regionsOffset + i * sizeof(BinaryAtlasRegion), sizeof(record));
+
+            if ((uint64_t)record.nameOffset + record.nameLength > header.stringTableSize ||
+                record.page >= header.pageCount)
+            {
+                spdlog::error("Invalid region name in binary texture atlas: {}", fileName);
+                throw;
+            }
+
+            TextureRegion textureRegion;
+            textureRegion.bounds = Rectangle(record.bounds[0], record.bounds[1], record.bounds[2], record.bounds[3]);
+            textureRegion.input = Rectangle(record.input[0], record.input[1], record.input[2], record.input[3]);
+            textureRegion.originTopLeft = {record.originTopLeft[0], record.originTopLeft[1]};
+            textureRegion.originBottomRight = {record.originBottomRight[0], record.originBottomRight[1]};
+            textureRegion.originCenter = {record.originCenter[0], record.originCenter[1]};
+            textureRegion.pivot = {record.pivot[0], record.pivot[1]};
+            textureRegion.rotated = (record.flags & binaryRegionRotated) != 0;
+            textureRegion.page = record.page;
+
+            AddRegion(std::string_view(stringTable + record.nameOffset, record.nameLength), textureRegion);
+        }
     }
 
-    TextureRegion TextureAtlas::GetRegion(const std::string &textureName) const
+    void TextureAtlas::SaveBinary(const std::string &fileName) const
     {
-        auto it = dictionary.find(textureName);
+        std::string stringTable;
+        std::vector<BinaryAtlasRegion> records(regions.size());
 
-        if (it == dictionary.end())
+        for (size_t i = 0; i < regions.size(); i++)
+        {
+            const TextureRegion &region = regions[i];
+            BinaryAtlasRegion &record = records[i];
+
+            record.bounds[0] = region.bounds.x;
+            record.bounds[1] = region.bounds.y;
+            record.bounds[2] = region.bounds.width;
+            record.bounds[3] = region.bounds.height;
+            record.input[0] = region.input.x;
+            record.input[1] = region.input.y;
+            record.input[2] = region.input.width;
+            record.input[3] = region.input.height;
+            record.originTopLeft[0] = region.originTopLeft.x;
+            record.originTopLeft[1] = region.originTopLeft.y;
+            record.originBottomRight[0] = region.originBottomRight.x;
+            record.originBottomRight[1] = region.originBottomRight.y;
+            record.originCenter[0] = region.originCenter.x;
+            record.originCenter[1] = region.originCenter.y;
+            record.pivot[0] = region.pivot.x;
+            record.pivot[1] = region.pivot.y;
+            record.flags = region.rotated ? binaryRegionRotated : 0;
+            record.page = region.page;
+            record.nameOffset = (uint32_t)stringTable.size();
+            record.nameLength = (uint32_t)regionNames[i].size();
+
+            stringTable += regionNames[i];
+        }
+
+        std::vector<BinaryAtlasPage> pages(imageNames.size());
+        for (size_t i = 0; i < imageNames.size(); i++)
+        {
+            pages[i].imageNameOffset = (uint32_t)stringTable.size();
+            pages[i].imageNameLength = (uint32_t)imageNames[i].size();
+            stringTable += imageNames[i];
+        }
+
+        BinaryAtlasHeader header;
+        memcpy(header.magic, binaryAtlasMagic, sizeof(header.magic));
+        header.version = binaryAtlasVersion;
+        header.regionCount = (uint32_t)records.size();
+        header.regionsOffset = sizeof(BinaryAtlasHeader);
+        header.pageCount = (uint32_t)pages.size();
+        header.pagesOffset = header.regionsOffset + (uint32_t)(records.size() * sizeof(BinaryAtlasRegion));
+        header.stringTableOffset = header.pagesOffset + (uint32_t)(pages.size() * sizeof(BinaryAtlasPage));
+        header.stringTableSize = (uint32_t)stringTable.size();
+
+        std::ofstream stream(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!stream)
+        {
+            spdlog::error("Failed to open binary texture atlas for writing: {}", fileName);
+            throw;
+        }
+
+        stream.write((const char *)&header, sizeof(header));
+        stream.write((const char *)records.data(), records.size() * sizeof(BinaryAtlasRegion));
+        stream.write((const char *)pages.data(), pages.size() * sizeof(BinaryAtlasPage));
+        stream.write(stringTable.data(), stringTable.size());
+
+        if (!stream)
+        {
+            spdlog::error("Failed to write binary texture atlas: {}", fileName);
+            throw;
+        }
+    }
+
+    std::vector<std::shared_ptr<Texture>> TextureAtlas::LoadPageTextures(
+        TextureFilter textureFilter, TextureFormat textureFormat, TextureAlphaMode alphaMode) const
+    {
+        struct DecodedPage
+        {
+            uint8_t *pixels;
+            int width;
+            int height;
+        };
+
+        // decoding is the slow part and stb_image is safe to call from several threads,
+        // the GL uploads have to stay on this one
+        std::vector<std::future<DecodedPage>> decodes;
+        decodes.reserve(texturePaths.size());
+
+        for (const std::string &texturePath : texturePaths)
+        {
+            decodes.push_back(std::async(std::launch::async, [&texturePath, alphaMode]() {
+                DecodedPage page;
+                int imageChannels;
+                page.pixels = stbi_load(texturePath.c_str(), &page.width, &page.height, &imageChannels, 4);
+
+                if (page.pixels != nullptr && alphaMode == TextureAlphaMode::Premultiplied)
+                {
+                    PremultiplyAlpha(page.pixels, page.width * page.height);
+                }
+
+                return page;
+            }));
+        }
+
+        std::vector<DecodedPage> decodedPages;
+        decodedPages.reserve(decodes.size());
+        for (auto &decode : decodes)
+        {
+            decodedPages.push_back(decode.get());
+        }
+
+        std::vector<std::shared_ptr<Texture>> textures;
+        textures.reserve(decodedPages.size());
+
+        for (size_t i = 0; i < decodedPages.size(); i++)
+        {
+            if (decodedPages[i].pixels == nullptr)
+            {
+                for (DecodedPage &decodedPage : decodedPages)
+                {
+                    stbi_image_free(decodedPage.pixels);
+                }
+
+                spdlog::error("Failed to load image file: {}", texturePaths[i]);
+                throw;
+            }
+        }
+
+        for (DecodedPage &decodedPage : decodedPages)
+        {
+            textures.push_back(std::make_shared<Texture>(TextureType::Default, decodedPage.width, decodedPage.height,
+                decodedPage.pixels, decodedPage.width * decodedPage.height * 4, textureFilter, textureFormat));
+            stbi_image_free(decodedPage.pixels);
+        }
+
+        return textures;
+    }
+
+    bool TextureAtlas::Contains(std::string_view textureName) const
+    {
+        return GetRegionId(textureName) != InvalidTextureRegionId;
+    }
+
+    const TextureRegion &TextureAtlas::GetRegion(std::string_view textureName) const
+    {
+        TextureRegionId regionId = GetRegionId(textureName);
+
+        if (regionId == InvalidTextureRegionId)
         {
             spdlog::error("TextureAtlas does not contain texture: {}", textureName);
             throw;
         }
 
-        return it->second;
+        return regions[regionId];
+    }
+
+    TextureRegionId TextureAtlas::GetRegionId(std::string_view textureName) const
+    {
+        if (lookupTable.empty())
+        {
+            return InvalidTextureRegionId;
+        }
+
+        uint32_t hash = HashName(textureName);
+        uint32_t mask = (uint32_t)lookupTable.size() - 1;
+
+        for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask)
+        {
+            TextureRegionId regionId = lookupTable[slot];
+            if (regionId == InvalidTextureRegionId)
+            {
+                return InvalidTextureRegionId;
+            }
+
+            if (regionHashes[regionId] == hash && regionNames[regionId] == textureName)
+            {
+                return regionId;
+            }
+        }
+    }
+
+    void TextureAtlas::AddRegion(std::string_view textureName, const TextureRegion &textureRegion)
+    {
+        // later entries with the same name replace earlier ones
+        TextureRegionId existing = GetRegionId(textureName);
+        if (existing != InvalidTextureRegionId)
+        {
+            regions[existing] = textureRegion;
+            return;
+        }
+
+        // keep the table at most half full so probe sequences stay short
+        if ((regions.size() + 1) * 2 > lookupTable.size())
+        {
+            GrowLookupTable();
+        }
+
+        TextureRegionId regionId = (TextureRegionId)regions.size();
+        uint32_t hash = HashName(textureName);
+
+        regions.push_back(textureRegion);
+        regionNames.emplace_back(textureName);
+        regionHashes.push_back(hash);
+
+        uint32_t mask = (uint32_t)lookupTable.size() - 1;
+        uint32_t slot = hash & mask;
+        while (lookupTable[slot] != InvalidTextureRegionId)
+        {
+            slot = (slot + 1) & mask;
+        }
+
+        lookupTable[slot] = regionId;
+    }
+
+    void TextureAtlas::GrowLookupTable()
+    {
+        size_t capacity = lookupTable.empty() ? 64 : lookupTable.size() * 2;
+        lookupTable.assign(capacity, InvalidTextureRegionId);
+
+        uint32_t mask = (uint32_t)capacity - 1;
+        for (TextureRegionId regionId = 0; regionId < (TextureRegionId)regions.size(); regionId++)
+        {
+            uint32_t slot = regionHashes[regionId] & mask;
+            while (lookupTable[slot] != InvalidTextureRegionId)
+            {
+                slot = (slot + 1) & mask;
+            }
+
+            lookupTable[slot] = regionId;
+        }
     }
 } // namespace Lucky
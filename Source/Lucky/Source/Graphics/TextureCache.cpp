@@ -0,0 +1,259 @@
+#include <assert.h>
+
+#include <spdlog/spdlog.h>
+
+#include <Lucky/Graphics/TextureCache.hpp>
+
+namespace Lucky
+{
+    TextureCache::TextureCache(uint64_t budgetBytes)
+        : budgetBytes(budgetBytes)
+    {
+    }
+
+    TextureCache::~TextureCache()
+    {
+        Clear();
+    }
+
+    std::shared_ptr<Texture> TextureCache::Get(const std::string &fileName, TextureFilter textureFilter,
+        TextureFormat textureFormat, TextureAlphaMode alphaMode)
+    {
+        ReleaseReplaced();
+
+        auto iterator = entries.find(fileName);
+
+        // a texture in another format or alpha mode would blend wrong for this caller, load it
+        // again the way it's asked for now, anyone still holding the old one keeps it
+        if (iterator != entries.end() &&
+            (iterator->second.textureFormat != textureFormat || iterator->second.alphaMode != alphaMode))
+        {
+            CacheEntry &entry = iterator->second;
+            spdlog::debug("TextureCache reloading texture in a different format or alpha mode: {}", fileName);
+
+            if (entry.texture)
+            {
+                Replace(entry);
+            }
+
+            entry.textureFormat = textureFormat;
+            entry.alphaMode = alphaMode;
+        }
+
+        if (iterator != entries.end() && iterator->second.texture)
+        {
+            CacheEntry &entry = iterator->second;
+            if (entry.texture->GetTextureFilter() != textureFilter)
+            {
+                entry.textureFilter = textureFilter;
+                entry.texture->SetTextureFilter(textureFilter);
+            }
+
+            Touch(entry);
+            return entry.texture;
+        }
+
+        // hold a reference so the new texture can't be chosen for eviction while trimming
+        std::shared_ptr<Texture> texture = Load(fileName, textureFilter, textureFormat, alphaMode).texture;
+        Trim();
+
+        return texture;
+    }
+
+    bool TextureCache::Contains(const std::string &fileName) const
+    {
+        return entries.find(fileName) != entries.end();
+    }
+
+    bool TextureCache::IsResident(const std::string &fileName) const
+    {
+        auto iterator = entries.find(fileName);
+        return iterator != entries.end() && iterator->second.texture != nullptr;
+    }
+
+    void TextureCache::Pin(const std::string &fileName, TextureFilter textureFilter, TextureFormat textureFormat,
+        TextureAlphaMode alphaMode)
+    {
+        auto texture = Get(fileName, textureFilter, textureFormat, alphaMode);
+        entries[fileName].pinned = true;
+    }
+
+    void TextureCache::Unpin(const std::string &fileName)
+    {
+        auto iterator = entries.find(fileName);
+        if (iterator == entries.end())
+        {
+            return;
+        }
+
+        iterator->second.pinned = false;
+        Trim();
+    }
+
+    void TextureCache::Remove(const std::string &fileName)
+    {
+        auto iterator = entries.find(fileName);
+        if (iterator == entries.end())
+        {
+            return;
+        }
+
+        if (iterator->second.texture)
+        {
+            Evict(iterator->second);
+        }
+
+        entries.erase(iterator);
+    }
+
+    void TextureCache::Clear()
+    {
+        lru.clear();
+        entries.clear();
+        replaced.clear();
+
+        residentBytes = 0;
+        residentCount = 0;
+        for (int i = 0; i < formatCount; i++)
+        {
+            formatBytes[i] = 0;
+        }
+    }
+
+    void TextureCache::Trim()
+    {
+        ReleaseReplaced();
+
+        auto iterator = lru.end();
+        while (residentBytes > budgetBytes && iterator != lru.begin())
+        {
+            --iterator;
+            CacheEntry &entry = **iterator;
+
+            // a texture that's referenced elsewhere wouldn't free any memory if we dropped it
+            if (entry.pinned || entry.texture.use_count() > 1)
+            {
+                continue;
+            }
+
+            // Evict removes the list node, so step forward first
+            ++iterator;
+            Evict(entry);
+        }
+    }
+
+    void TextureCache::SetBudget(uint64_t budget)
+    {
+        budgetBytes = budget;
+        Trim();
+    }
+
+    uint64_t TextureCache::GetResidentBytes(TextureFormat textureFormat) const
+    {
+        int formatIndex = static_cast<int>(textureFormat);
+        assert(formatIndex >= 0 && formatIndex < formatCount);
+
+        return formatBytes[formatIndex];
+    }
+
+    TextureCache::CacheEntry &TextureCache::Load(const std::string &fileName, TextureFilter textureFilter,
+        TextureFormat textureFormat, TextureAlphaMode alphaMode)
+    {
+        CacheEntry &entry = entries[fileName];
+        bool reloading = !entry.fileName.empty();
+
+        if (!reloading)
+        {
+            entry.fileName = fileName;
+            entry.textureFilter = textureFilter;
+            entry.textureFormat = textureFormat;
+            entry.alphaMode = alphaMode;
+            entry.pinned = false;
+        }
+        else
+        {
+            // Get has already brought the format and alpha mode up to date
+            entry.textureFilter = textureFilter;
+        }
+
+        entry.texture =
+            std::make_shared<Texture>(fileName, entry.textureFilter, entry.textureFormat, entry.alphaMode);
+        entry.bytes = entry.texture->GetMemorySize();
+
+        residentBytes += entry.bytes;
+        formatBytes[static_cast<int>(entry.textureFormat)] += entry.bytes;
+        residentCount++;
+
+        lru.push_front(&entry);
+        entry.lruPosition = lru.begin();
+
+        if (reloading)
+        {
+            spdlog::debug("TextureCache reloaded evicted texture: {}", fileName);
+        }
+
+        return entry;
+    }
+
+    void TextureCache::Touch(CacheEntry &entry)
+    {
+        if (entry.lruPosition != lru.begin())
+        {
+            lru.splice(lru.begin(), lru, entry.lruPosition);
+        }
+    }
+
+    void TextureCache::Evict(CacheEntry &entry)
+    {
+        assert(entry.texture);
+
+        lru.erase(entry.lruPosition);
+        entry.texture.reset();
+
+        residentBytes -= entry.bytes;
+        formatBytes[static_cast<int>(entry.textureFormat)] -= entry.bytes;
+        residentCount--;
+        evictionCount++;
+    }
+
+    void TextureCache::Replace(CacheEntry &entry)
+    {
+        assert(entry.texture);
+
+        lru.erase(entry.lruPosition);
+        residentCount--;
+
+        // a reload isn't memory pressure, so it's not an eviction, but the old texture's memory
+        // is only freed once its other holders let go of it
+        if (entry.texture.use_count() > 1)
+        {
+            replaced.push_back({entry.texture, entry.bytes, entry.textureFormat});
+        }
+        else
+        {
+            residentBytes -= entry.bytes;
+            formatBytes[static_cast<int>(entry.textureFormat)] -= entry.bytes;
+        }
+
+        entry.texture.reset();
+    }
+
+    void TextureCache::ReleaseReplaced()
+    {
+        for (size_t i = 0; i < replaced.size();)
+        {
+            ReplacedTexture &replacedTexture = replaced[i];
+            if (replacedTexture.texture.use_count() > 1)
+            {
+                i++;
+                continue;
+            }
+
+            residentBytes -= replacedTexture.bytes;
+            formatBytes[static_cast<int>(replacedTexture.textureFormat)] -= replacedTexture.bytes;
+
+            replaced[i] = std::move(replaced.back());
+            replaced.pop_back();
+        }
+    }
+} // namespace Lucky
@@ -59,5 +59,12 @@ namespace Lucky
             glVertexAttribPointer(texcoordLocation, 2, GL_FLOAT, 0, sizeof(Vertex), (void *)(sizeof(float) * 2));
             glEnableVertexAttribArray(texcoordLocation);
         }
+
+        auto textureIndexLocation = shaderProgram.GetAttributeLocation("textureindex");
+        if (textureIndexLocation != -1)
+        {
+            glVertexAttribPointer(textureIndexLocation, 1, GL_FLOAT, 0, sizeof(Vertex), (void *)(sizeof(float) * 8));
+            glEnableVertexAttribArray(textureIndexLocation);
+        }
     }
 } // namespace Lucky
\ No newline at end of file
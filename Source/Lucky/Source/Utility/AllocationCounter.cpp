@@ -0,0 +1,74 @@
+#include <new>
+#include <stdlib.h>
+
+#include <Lucky/Utility/AllocationCounter.hpp>
+
+namespace Lucky
+{
+    static thread_local uint64_t threadAllocationCount = 0;
+
+    uint64_t GetThreadAllocationCount()
+    {
+        return threadAllocationCount;
+    }
+} // namespace Lucky
+
+#if defined(_DEBUG)
+// the array and nothrow forms of new and delete end up in these, and every form is counted
+void *operator new(size_t size)
+{
+    Lucky::threadAllocationCount++;
+
+    void *memory = malloc(size > 0 ? size : 1);
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+
+    return memory;
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    Lucky::threadAllocationCount++;
+
+    // aligned_alloc wants a multiple of the alignment, and Windows frees these with _aligned_free
+    size_t align = static_cast<size_t>(alignment);
+    size_t alignedSize = (size > 0 ? size + align - 1 : align) / align * align;
+#if defined(_WIN32)
+    void *memory = _aligned_malloc(alignedSize, align);
+#else
+    void *memory = aligned_alloc(align, alignedSize);
+#endif
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+#if defined(_WIN32)
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void operator delete(void *memory, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(memory, alignment);
+}
+#endif
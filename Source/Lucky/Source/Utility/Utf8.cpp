@@ -0,0 +1,189 @@
+#include <string.h>
+
+#include <Lucky/Utility/Utf8.hpp>
+
+/* clang-format off */
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+	#include <emmintrin.h>
+	#define LUCKY_UTF8_SSE2
+
+#elif defined(_M_ARM64) || defined(__aarch64__)
+	#include <arm_neon.h>
+	#define LUCKY_UTF8_NEON
+
+#endif
+/* clang-format on */
+
+namespace Lucky
+{
+    // Widens 16 bytes to code points if none of them has the high bit set
+    static inline bool CopyAscii16(const uint8_t *s, int *d)
+    {
+#if defined(LUCKY_UTF8_SSE2)
+        __m128i bytes = _mm_loadu_si128((const __m128i *)s);
+        if (_mm_movemask_epi8(bytes) != 0)
+        {
+            return false;
+        }
+
+        __m128i zero = _mm_setzero_si128();
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128((__m128i *)(d + 4), _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128((__m128i *)(d + 8), _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128((__m128i *)(d + 12), _mm_unpackhi_epi16(high, zero));
+        return true;
+#elif defined(LUCKY_UTF8_NEON)
+        uint8x16_t bytes = vld1q_u8(s);
+        if (vmaxvq_u8(bytes) >= 0x80)
+        {
+            return false;
+        }
+
+        uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+        uint16x8_t high = vmovl_u8(vget_high_u8(bytes));
+        vst1q_s32(d, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(low))));
+        vst1q_s32(d + 4, vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(low))));
+        vst1q_s32(d + 8, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(high))));
+        vst1q_s32(d + 12, vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(high))));
+        return true;
+#else
+        uint64_t words[2];
+        memcpy(words, s, 16);
+        if (((words[0] | words[1]) & 0x8080808080808080ull) != 0)
+        {
+            return false;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            d[i] = s[i];
+        }
+        return true;
+#endif
+    }
+
+    int DecodeUtf8(const std::string &text, size_t &position)
+    {
+        const uint8_t *s = (const uint8_t *)text.data() + position;
+        size_t remaining = text.size() - position;
+
+        uint8_t lead = s[0];
+        if (lead < 0x80)
+        {
+            position++;
+            return lead;
+        }
+
+        int length, codePoint, minimum;
+        if ((lead & 0xE0) == 0xC0)
+        {
+            length = 2;
+            codePoint = lead & 0x1F;
+            minimum = 0x80;
+        }
+        else if ((lead & 0xF0) == 0xE0)
+        {
+            length = 3;
+            codePoint = lead & 0x0F;
+            minimum = 0x800;
+        }
+        else if ((lead & 0xF8) == 0xF0)
+        {
+            length = 4;
+            codePoint = lead & 0x07;
+            minimum = 0x10000;
+        }
+        else
+        {
+            position++;
+            return ReplacementCharacter;
+        }
+
+        if (remaining < (size_t)length)
+        {
+            position++;
+            return ReplacementCharacter;
+        }
+
+        for (int i = 1; i < length; i++)
+        {
+            if ((s[i] & 0xC0) != 0x80)
+            {
+                position++;
+                return ReplacementCharacter;
+            }
+
+            codePoint = (codePoint << 6) | (s[i] & 0x3F);
+        }
+
+        if (codePoint < minimum || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+        {
+            position++;
+            return ReplacementCharacter;
+        }
+
+        position += length;
+        return codePoint;
+    }
+
+    void DecodeUtf8(const std::string &text, std::vector<int> &output)
+    {
+        // never more code points than bytes, so write straight into the vector and trim it after
+        size_t first = output.size();
+        output.resize(first + text.size());
+
+        const uint8_t *s = (const uint8_t *)text.data();
+        int *d = output.data() + first;
+        size_t position = 0;
+
+        while (position < text.size())
+        {
+            // most text is ASCII, take it 16 bytes at a time until a multibyte sequence shows up
+            while (position + 16 <= text.size() && CopyAscii16(s + position, d))
+            {
+                position += 16;
+                d += 16;
+            }
+
+            if (position < text.size())
+            {
+                *d++ = s[position] < 0x80 ? s[position++] : DecodeUtf8(text, position);
+            }
+        }
+
+        output.resize(d - output.data());
+    }
+
+    void EncodeUtf8(int codePoint, std::string &output)
+    {
+        if (codePoint < 0 || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+        {
+            codePoint = ReplacementCharacter;
+        }
+
+        if (codePoint < 0x80)
+        {
+            output += (char)codePoint;
+        }
+        else if (codePoint < 0x800)
+        {
+            output += (char)(0xC0 | (codePoint >> 6));
+            output += (char)(0x80 | (codePoint & 0x3F));
+        }
+        else if (codePoint < 0x10000)
+        {
+            output += (char)(0xE0 | (codePoint >> 12));
+            output += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            output += (char)(0x80 | (codePoint & 0x3F));
+        }
+        else
+        {
+            output += (char)(0xF0 | (codePoint >> 18));
+            output += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+            output += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            output += (char)(0x80 | (codePoint & 0x3F));
+        }
+    }
+} // namespace Lucky